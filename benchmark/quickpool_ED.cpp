@@ -2,6 +2,8 @@
 
 #include "utils.h"
 #include "ED_eval.h"
+#include "Candidate_filter.h"
+#include "pair_check.h"
 
 using namespace quickpool;
 using json = nlohmann::json;
@@ -26,6 +28,21 @@ void benchmark(const bpo::variables_map &opts)
     auto seed = opts["seed"].as<size_t>();
     auto repeat = opts["repeat"].as<size_t>();
     auto port = opts["port"].as<int>();
+    auto cell_size = opts["cell-size"].as<size_t>();
+    auto memory_budget = opts["memory-budget"].as<size_t>();
+    auto fixed_key_prg = opts["fixed-key-prg"].as<bool>();
+    auto funshade = opts["funshade"].as<bool>();
+    auto buckets = opts["buckets"].as<size_t>();
+    auto shared_inputs = opts["shared-inputs"].as<bool>();
+    auto pin_threads = opts["pin-threads"].as<bool>();
+    auto pair_checks = opts["pair-checks"].as<size_t>();
+
+    // one executor for all the evaluators of the process
+    Executor::configureGlobal(threads, pin_threads);
+    auto executor = Executor::global();
+
+    // DCF keys are generated by SP and evaluated by the others, all parties must use the same PRG
+    DCF_set_prg(fixed_key_prg ? DCF_PRG_FIXED_KEY : DCF_PRG_MP);
 
     int nP = riderCount + driverCount;
 
@@ -69,6 +86,14 @@ void benchmark(const bpo::variables_map &opts)
                               {"security_param", security_param},
                               {"threads", threads},
                               {"seed", seed},
+                              {"cell-size", cell_size},
+                              {"memory-budget", memory_budget},
+                              {"fixed-key-prg", fixed_key_prg},
+                              {"funshade", funshade},
+                              {"buckets", buckets},
+                              {"shared-inputs", shared_inputs},
+                              {"pin-threads", pin_threads},
+                              {"pair-checks", pair_checks},
                               {"repeat", repeat}};
     output_data["benchmarks"] = json::array();
 
@@ -83,29 +108,79 @@ void benchmark(const bpo::variables_map &opts)
     std::mt19937 gen(rand());
     std::uniform_int_distribution<uint> distrib(0, 1000);
 
+    // optional coarse pre-filter: only the candidate pairs are evaluated securely
+    std::vector<std::vector<bool>> candidates(riderCount, std::vector<bool>(driverCount, true));
+    // own start and end positions, sampled independently by every party
+    std::mt19937 pos_gen(rand() + pid);
+    std::vector<Field> position(4);
+    for (auto &coord : position)
+    {
+        coord = Field(distrib(pos_gen));
+    }
+    if (cell_size > 0)
+    {
+        Candidate_filter filter(pid, riderCount, driverCount, network, Field(cell_size));
+        filter.setInputs(position[0], position[1], position[2], position[3]);
+        StatsPoint start(*network);
+        candidates = filter.processCandidates();
+        StatsPoint end(*network);
+        output_data["filter"] = end - start;
+
+        size_t num_candidates = 0;
+        for (const auto &row : candidates)
+        {
+            num_candidates += std::count(row.begin(), row.end(), true);
+        }
+        output_data["filter"]["candidates"] = num_candidates;
+        std::cout << "candidate pairs: " << num_candidates << " out of " << riderCount * driverCount << "\n";
+    }
+
+    // in the tiled mode the circuit is generated tile by tile within the memory budget (in MB),
+    // out of which the process already holds its resident set
+    size_t budget_bytes = memory_budget << 20;
+    size_t resident = std::max<int64_t>(residentSetBytes(), 0);
+    size_t tile_side = memory_budget > 0
+                           ? ED_eval::tileSide(budget_bytes > resident ? budget_bytes - resident : 0, riderCount, driverCount)
+                           : 0;
+
+    // the tiled and the funshade mode take the own position instead of the circuit inputs
+    bool position_only = memory_budget > 0 || funshade;
+
     // constructing the circuit for computing Euclidean distances between 
     //start and end positions of a rider and a driver
-    auto circ = Circuit<Field>::generateEDSCircuit(riderCount, driverCount);
+    auto circ = position_only   ? Circuit<Field>()
+                : shared_inputs ? Circuit<Field>::generateEDSSharedCircuit(riderCount, driverCount, candidates)
+                                : Circuit<Field>::generateEDSCircuit(riderCount, driverCount, candidates);
     std::unordered_map<wire_t, int> input_pid_map;
     std::unordered_map<wire_t, Field> inputs;
 
-    // setting random inputs
-    for (int rider = 0, j = 0; rider < riderCount; rider++)
+    // every party inputs its own position once to the shared input wires
+    if (shared_inputs && !position_only)
+    {
+        setEDSSharedInputs(riderCount, driverCount, position, input_pid_map, inputs);
+    }
+
+    // setting random inputs, or the own positions when the pre-filter is enabled
+    for (int rider = 0, j = 0; rider < riderCount && !position_only && !shared_inputs; rider++)
     {
         int rider_id = rider + 1;
         for (int driver = 0; driver < driverCount; driver++)
         {
+            if (!candidates[rider][driver])
+            {
+                continue;
+            }
             int driver_id = driver + riderCount + 1;
             for (int i = 0; i < 2; ++i)
             {
                 input_pid_map[j] = rider_id;
-                inputs[j++] = Field(distrib(gen));
+                inputs[j++] = cell_size > 0 ? position[i] : Field(distrib(gen));
                 input_pid_map[j] = rider_id;
-                inputs[j++] = Field(distrib(gen));
+                inputs[j++] = cell_size > 0 ? position[2 + i] : Field(distrib(gen));
                 input_pid_map[j] = driver_id;
-                inputs[j++] = Field(distrib(gen));
+                inputs[j++] = cell_size > 0 ? position[i] : Field(distrib(gen));
                 input_pid_map[j] = driver_id;
-                inputs[j++] = Field(distrib(gen));
+                inputs[j++] = cell_size > 0 ? position[2 + i] : Field(distrib(gen));
             }
             j += 6; // to skip subtraction gates and dotproduct gates in the circuit
         }
@@ -115,15 +190,34 @@ void benchmark(const bpo::variables_map &opts)
 
     for (size_t r = 0; r < repeat; ++r)
     {
-        ED_eval endpoint_eval(pid, riderCount, driverCount, network, level_circ, security_param, threads, seed);
+        ED_eval endpoint_eval(pid, riderCount, driverCount, network, level_circ, security_param, executor, seed);
+        auto phases = std::make_shared<io::PhaseRecorder>();
+        endpoint_eval.setPhaseRecorder(phases);
+        endpoint_eval.setDistanceBuckets(buckets);
 
+        executor->resetMetrics();
         StatsPoint start(*network);
 
         // calling the function for securely executing end-point based matching
-        auto match = endpoint_eval.pair_EDMatching(input_pid_map, inputs);
+        auto match = funshade            ? endpoint_eval.pair_EDMatchingFunshade(position)
+                     : memory_budget > 0 ? endpoint_eval.pair_EDMatchingTiled(position, tile_side, tile_side)
+                                         : endpoint_eval.pair_EDMatching(input_pid_map, inputs);
 
         StatsPoint end(*network);
         auto rbench = end - start;
+        auto load = executor->metrics();
+        rbench["executor"] = {{"workers", load.workers},
+                              {"queued", load.queued},
+                              {"tasks", load.started},
+                              {"stolen", load.stolen},
+                              {"utilization", load.utilization}};
+        rbench["phases"] = json::object();
+        for (const auto &phase : phases->phases())
+        {
+            rbench["phases"][phase.name] = {{"time", phase.time},
+                                            {"communication", phase.communication},
+                                            {"rounds", phase.rounds}};
+        }
         output_data["benchmarks"].push_back(rbench);
 
         size_t bytes_sent = 0;
@@ -135,11 +229,49 @@ void benchmark(const bpo::variables_map &opts)
         std::cout << "--- Repetition " << r + 1 << " ---\n";
         std::cout << "time: " << rbench["time"] << " ms\n";
         std::cout << "sent: " << bytes_sent << " bytes\n";
+        std::cout << "executor: " << load.started << " tasks (" << load.stolen << " stolen), "
+                  << 100 * load.utilization << "% utilization\n";
+        for (const auto &phase : phases->phases())
+        {
+            std::cout << "  " << phase.name << ": " << phase.time << " ms, " << phase.rounds << " rounds\n";
+        }
 
         std::cout << std::endl;
     }
+    // re-checks of the pair of the first rider and the first driver on material prepared in one
+    // batch, the other riders and drivers take no part
+    if (pair_checks > 0 && (pid == 0 || pid == 1 || pid == riderCount + 1))
+    {
+        auto spec = MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD);
+        PairCheck pair(pid, riderCount, driverCount, network, 1, riderCount + 1, spec, security_param, executor, seed);
+        StatsPoint start(*network);
+        pair.prepare(pair_checks);
+        StatsPoint prepared(*network);
+        for (size_t c = 0; c < pair_checks; ++c)
+        {
+            pair.check(position);
+        }
+        StatsPoint end(*network);
+        auto offline = prepared - start;
+        auto online = end - prepared;
+        double per_check = online["time"].get<double>() / pair_checks;
+        output_data["pair_check"] = {{"prepare", offline},
+                                     {"online", online},
+                                     {"online_time_per_check", per_check}};
+
+        std::cout << "--- Pair checks ---\n";
+        std::cout << "prepare: " << offline["time"] << " ms for " << pair_checks << " checks\n";
+        std::cout << "online: " << per_check << " ms per check\n";
+        std::cout << std::endl;
+    }
+
     output_data["stats"] = {{"peak_virtual_memory", peakVirtualMemory()},
                             {"peak_resident_set_size", peakResidentSetSize()}};
+    if (memory_budget > 0)
+    {
+        output_data["stats"]["tile_side"] = tile_side;
+        output_data["stats"]["within_memory_budget"] = peakResidentSetBytes() <= int64_t(budget_bytes);
+    }
 
     std::cout << "--- Statistics ---\n";
     for (const auto &[key, value] : output_data["stats"].items())
@@ -163,10 +295,18 @@ bpo::options_description programOptions() {
         ("pid,p", bpo::value<size_t>()->required(), "Party ID.")
         ("security-param", bpo::value<size_t>()->default_value(128), "Security parameter in bits.")
         ("threads,t", bpo::value<size_t>()->default_value(6), "Number of threads (recommended 6).")
+        ("pin-threads", bpo::bool_switch(), "Pin the threads of the executor to CPUs, spread over the NUMA nodes.")
         ("seed", bpo::value<size_t>()->default_value(200), "Value of the random seed.")
         ("net-config", bpo::value<std::string>(), "Path to JSON file containing network details of all parties.")
         ("localhost", bpo::bool_switch(), "All parties are on same machine.")
         ("port", bpo::value<int>()->default_value(10000), "Base port for networking.")
+        ("cell-size", bpo::value<size_t>()->default_value(0), "Grid cell size of the candidate pre-filter (0 disables it).")
+        ("memory-budget", bpo::value<size_t>()->default_value(0), "Memory budget in MB for tiled evaluation of all pairs (0 disables it).")
+        ("fixed-key-prg", bpo::bool_switch(), "Use the fixed-key AES PRG for the DCF keys.")
+        ("funshade", bpo::bool_switch(), "Threshold the distances of all pairs with the funshade scalar product and sign gate.")
+        ("buckets", bpo::value<size_t>()->default_value(1), "Distance buckets revealed to SP for the min-cost matching (1 only reveals the matches).")
+        ("shared-inputs", bpo::bool_switch(), "Input the position of every party once, shared by all of its pairs.")
+        ("pair-checks", bpo::value<size_t>()->default_value(0), "Number of prepared re-checks of the first rider and driver to time after the matching.")
         ("output,o", bpo::value<std::string>(), "File to save benchmarks.")
         ("repeat,re", bpo::value<size_t>()->default_value(1), "Number of times to run benchmarks.");
 
@@ -32,6 +32,7 @@ void benchmark(const bpo::variables_map &opts)
     auto pid = opts["pid"].as<size_t>();
     auto security_param = opts["security-param"].as<size_t>();
     auto threads = opts["threads"].as<size_t>();
+    Executor::configureGlobal(threads, false);
     auto seed = opts["seed"].as<size_t>();
     auto repeat = opts["repeat"].as<size_t>();
     auto port = opts["port"].as<int>();
@@ -91,7 +92,7 @@ void benchmark(const bpo::variables_map &opts)
     for (size_t r = 0; r < repeat; ++r)
     {
 
-        Intersection_eval quickpool_int(pid, riderCount, driverCount, network, security_param, threads, seed);
+        Intersection_eval quickpool_int(pid, riderCount, driverCount, network, security_param, Executor::global(), seed);
 
         // setting random inputs
         quickpool_int.setInputs();
@@ -79,6 +79,21 @@ int64_t peakResidentSetSize() {
   return info.resident_size_max;
 }
 
+int64_t residentSetBytes() {
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+  kern_return_t ret = task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                                reinterpret_cast<task_info_t>(&info), &count);
+  if (ret != KERN_SUCCESS || count != MACH_TASK_BASIC_INFO_COUNT) {
+    return -1;
+  }
+
+  return info.resident_size;
+}
+
+int64_t peakResidentSetBytes() { return peakResidentSetSize(); }
+
 int64_t peakVirtualMemory() {
   // No way to get peak virtual memory usage on OSX.
   return peakResidentSetSize();
@@ -113,8 +128,22 @@ int64_t getProcStatus(const std::string& key) {
 int64_t peakVirtualMemory() { return getProcStatus("VmPeak:"); }
 
 int64_t peakResidentSetSize() { return getProcStatus("VmHWM:"); }
+
+int64_t residentSetBytes() {
+  int64_t kb = getProcStatus("VmRSS:");
+  return kb < 0 ? -1 : kb * 1024;
+}
+
+int64_t peakResidentSetBytes() {
+  int64_t kb = peakResidentSetSize();
+  return kb < 0 ? -1 : kb * 1024;
+}
 #else
 int64_t peakVirtualMemory() { return -1; }
 
 int64_t peakResidentSetSize() { return -1; }
+
+int64_t residentSetBytes() { return -1; }
+
+int64_t peakResidentSetBytes() { return -1; }
 #endif
@@ -38,3 +38,6 @@ bool saveJson(const nlohmann::json& data, const std::string& fpath);
 void initNTL(size_t num_threads);
 int64_t peakVirtualMemory();
 int64_t peakResidentSetSize();
+// current and peak resident set size in bytes on every platform, -1 when unknown
+int64_t residentSetBytes();
+int64_t peakResidentSetBytes();
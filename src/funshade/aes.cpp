@@ -1,6 +1,8 @@
 #include "aes.h"
 
 const uint8_t iv_aes_128[AES_BLOCKLEN]  = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+// Public key of the fixed-key PRG (G_fk_*), its round keys are expanded only once
+const uint8_t fk_aes_128[AES_BLOCKLEN]  = {0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97};
 
 //----------------------------------------------------------------------------//
 //--------------------------- PRIVATE - AES_TINY -----------------------------//
@@ -150,6 +152,12 @@ static void aes128_tiny_enc_ecb(const uint8_t *enc_key, const uint8_t *plainText
   AES_init_ctx(&ctx, enc_key);
   Cipher((state_t*)cipherText, ctx.RoundKey);}
 
+static const uint8_t* fk_tiny_round_keys(){
+  static struct AES_ctx ctx;
+  static bool init = (AES_init_ctx(&ctx, fk_aes_128), true);
+  (void)init;
+  return ctx.RoundKey;}
+
 
 //----------------------------------------------------------------------------//
 //---------------------------- PRIVATE AES_NI --------------------------------//
@@ -194,6 +202,78 @@ static void aes128_ni_enc_ecb(const uint8_t *enc_key, const uint8_t *plainText,u
     aes128_gen_key_schedule(enc_key, key_schedule);
     aes128_enc(key_schedule, plainText, cipherText);
 }
+
+static const __m128i* fk_ni_key_schedule(){
+    static __m128i key_schedule[11];
+    static bool init = (aes128_gen_key_schedule(fk_aes_128, key_schedule), true);
+    (void)init;
+    return key_schedule;
+}
+
+// Correlation-robust hash pi(x)^x under the fixed key, over n independent blocks.
+// The rounds of all blocks are interleaved; no key schedule is computed.
+static void aes128_ni_fk_blocks(size_t n, const __m128i x[], __m128i out[]){
+    const __m128i *ks = fk_ni_key_schedule();
+    size_t l, r;
+    for (l = 0; l < n; l++) {
+        out[l] = _mm_xor_si128(x[l], ks[0]);
+    }
+    for (r = 1; r < 10; r++) {
+        for (l = 0; l < n; l++) {
+            out[l] = _mm_aesenc_si128(out[l], ks[r]);
+        }
+    }
+    for (l = 0; l < n; l++) {
+        out[l] = _mm_xor_si128(_mm_aesenclast_si128(out[l], ks[10]), x[l]);
+    }
+}
+
+// Miyaguchi–Preneel over n<=AES_LANES independent (key, msg) lanes. The key
+// schedules are expanded on the fly and every round is issued for all lanes
+// before the next one, so the AES unit works on n independent blocks at once.
+// aeskeygenassist has a poor throughput, so with SSSE3 the round keys are derived
+// with pshufb+aesenclast instead, which pipeline like the encryption rounds.
+#ifdef __SSSE3__
+#define AES_LANES_KEY_EXP(k, rcon) (                                            \
+    t = _mm_aesenclast_si128(_mm_shuffle_epi8(k, rot), rcon),                   \
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4)),                                 \
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4)),                                 \
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4)),                                 \
+    _mm_xor_si128(k, t))
+#define AES_LANES_RCON(c) _mm_set1_epi32(c)
+#else
+#define AES_LANES_KEY_EXP(k, rcon) AES_128_key_exp(k, rcon)
+#define AES_LANES_RCON(c) c
+#endif
+#define AES_LANES_ROUND(c)                                                      \
+    for (l = 0; l < n; l++) {                                                   \
+        ks[l] = AES_LANES_KEY_EXP(ks[l], AES_LANES_RCON(c));                    \
+        m[l] = _mm_aesenc_si128(m[l], ks[l]);                                   \
+    }
+static void aes128_ni_mp_lanes(size_t n, const __m128i key[], const __m128i msg[], __m128i out[]){
+    __m128i ks[AES_LANES], m[AES_LANES];
+    size_t l;
+#ifdef __SSSE3__
+    // RotWord of the last word, broadcast to all words (SubWord is done by aesenclast)
+    const __m128i rot = _mm_set1_epi32(0x0c0f0e0d);
+    __m128i t;
+#endif
+    for (l = 0; l < n; l++) {
+        ks[l] = key[l];
+        m[l] = _mm_xor_si128(msg[l], ks[l]);
+    }
+    AES_LANES_ROUND(0x01) AES_LANES_ROUND(0x02) AES_LANES_ROUND(0x04)
+    AES_LANES_ROUND(0x08) AES_LANES_ROUND(0x10) AES_LANES_ROUND(0x20)
+    AES_LANES_ROUND(0x40) AES_LANES_ROUND(0x80) AES_LANES_ROUND(0x1B)
+    for (l = 0; l < n; l++) {
+        ks[l] = AES_LANES_KEY_EXP(ks[l], AES_LANES_RCON(0x36));
+        m[l] = _mm_aesenclast_si128(m[l], ks[l]);
+        out[l] = _mm_xor_si128(m[l], _mm_xor_si128(key[l], msg[l]));   // XOR3
+    }
+}
+#undef AES_LANES_ROUND
+#undef AES_LANES_RCON
+#undef AES_LANES_KEY_EXP
 #endif
 
 //----------------------------------------------------------------------------//
@@ -251,3 +331,127 @@ void G_ni(const uint8_t buffer_in[], uint8_t buffer_out[],
     }
 }
 #endif
+#ifdef __AES__
+void G_ni_lanes(size_t n, const uint8_t buffer_in[], uint8_t buffer_out[],
+           size_t buffer_out_size){
+    __m128i key[AES_LANES], msg[AES_LANES];
+    size_t i, l;
+    assertm(n<=AES_LANES, "at most AES_LANES lanes can be hashed at once");
+    assertm(buffer_out_size%AES_BLOCKLEN==0, "buffer_out must be a multiple of 16 bytes");
+    for (l = 0; l < n; l++) {
+        msg[l] = _mm_loadu_si128((const __m128i*) &buffer_in[l*AES_BLOCKLEN]);
+        key[l] = _mm_loadu_si128((const __m128i*) iv_aes_128);
+    }
+    // Each lane chains its previous output block as the key of the next one
+    for (i = 0; i < buffer_out_size; i+=AES_BLOCKLEN){
+        aes128_ni_mp_lanes(n, key, msg, key);
+        for (l = 0; l < n; l++) {
+            _mm_storeu_si128((__m128i*) &buffer_out[l*buffer_out_size + i], key[l]);
+        }
+    }
+}
+#endif
+
+// Fixed-key PRG: block j of the output is pi(in^j)^(in^j), with pi the AES-128
+// permutation under fk_aes_128 and j XORed into the first byte of in.
+void G_fk_tiny(const uint8_t buffer_in[], uint8_t buffer_out[],
+           size_t buffer_in_size, size_t buffer_out_size){
+    uint8_t x[AES_BLOCKLEN];
+    size_t i, j;
+    assertm(buffer_in_size==AES_BLOCKLEN, "buffer_in must be of 16 bytes (128 bits)");
+    assertm(buffer_out_size%AES_BLOCKLEN==0, "buffer_out must be a multiple of 16 bytes");
+    assertm(buffer_out_size<=256*AES_BLOCKLEN, "the block counter is a single byte");
+    for (i = 0; i < buffer_out_size; i+=AES_BLOCKLEN){
+        memcpy(x, buffer_in, AES_BLOCKLEN);
+        x[0] ^= (uint8_t)(i/AES_BLOCKLEN);
+        memcpy(&buffer_out[i], x, AES_BLOCKLEN);
+        Cipher((state_t*)&buffer_out[i], fk_tiny_round_keys());
+        for (j = 0; j < AES_BLOCKLEN; j++) {
+            buffer_out[i+j] ^= x[j];
+        }
+    }
+}
+#ifdef __AES__
+void G_fk_ni(const uint8_t buffer_in[], uint8_t buffer_out[],
+           size_t buffer_in_size, size_t buffer_out_size){
+    assertm(buffer_in_size==AES_BLOCKLEN, "buffer_in must be of 16 bytes (128 bits)");
+    G_fk_ni_lanes(1, buffer_in, buffer_out, buffer_out_size);
+}
+
+void G_fk_ni_lanes(size_t n, const uint8_t buffer_in[], uint8_t buffer_out[],
+           size_t buffer_out_size){
+    __m128i x[AES_LANES], out[AES_LANES];
+    size_t i, l;
+    assertm(n<=AES_LANES, "at most AES_LANES lanes can be hashed at once");
+    assertm(buffer_out_size%AES_BLOCKLEN==0, "buffer_out must be a multiple of 16 bytes");
+    assertm(buffer_out_size<=256*AES_BLOCKLEN, "the block counter is a single byte");
+    // Blocks are independent, so all blocks of all lanes could be in flight; we
+    // go one block index at a time to keep at most AES_LANES blocks in registers
+    for (i = 0; i < buffer_out_size; i+=AES_BLOCKLEN){
+        const __m128i ctr = _mm_cvtsi32_si128((int)(i/AES_BLOCKLEN));
+        for (l = 0; l < n; l++) {
+            x[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i*) &buffer_in[l*AES_BLOCKLEN]), ctr);
+        }
+        aes128_ni_fk_blocks(n, x, out);
+        for (l = 0; l < n; l++) {
+            _mm_storeu_si128((__m128i*) &buffer_out[l*buffer_out_size + i], out[l]);
+        }
+    }
+}
+#endif
+
+// Counter mode: the 128-bit little-endian counter is incremented once per block
+static void ctr_increment(uint8_t ctr[AES_BLOCKLEN]){
+  size_t i;
+  for (i = 0; i < AES_BLOCKLEN; i++){
+    if (++ctr[i] != 0) break;
+  }
+}
+
+void AES_CTR_tiny(const uint8_t key[AES_BLOCKLEN], uint8_t ctr[AES_BLOCKLEN],
+                  uint8_t buffer_out[], size_t buffer_out_size){
+  struct AES_ctx ctx;
+  uint8_t block[AES_BLOCKLEN];
+  size_t i, len;
+  AES_init_ctx(&ctx, key);
+  for (i = 0; i < buffer_out_size; i += AES_BLOCKLEN){
+    memcpy(block, ctr, AES_BLOCKLEN);
+    Cipher((state_t*)block, ctx.RoundKey);
+    len = (buffer_out_size - i < AES_BLOCKLEN) ? buffer_out_size - i : AES_BLOCKLEN;
+    memcpy(&buffer_out[i], block, len);
+    ctr_increment(ctr);
+  }
+}
+#ifdef __AES__
+// AES_LANES counter blocks are encrypted at a time, with their rounds interleaved
+void AES_CTR_ni(const uint8_t key[AES_BLOCKLEN], uint8_t ctr[AES_BLOCKLEN],
+                uint8_t buffer_out[], size_t buffer_out_size){
+  __m128i key_schedule[11], m[AES_LANES];
+  uint8_t block[AES_BLOCKLEN];
+  size_t i, l, r, n, len;
+  aes128_gen_key_schedule(key, key_schedule);
+  for (i = 0; i < buffer_out_size; i += n*AES_BLOCKLEN){
+    n = (buffer_out_size - i + AES_BLOCKLEN - 1) / AES_BLOCKLEN;
+    n = (n < AES_LANES) ? n : AES_LANES;
+    for (l = 0; l < n; l++){
+      m[l] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)ctr), key_schedule[0]);
+      ctr_increment(ctr);
+    }
+    for (r = 1; r < 10; r++){
+      for (l = 0; l < n; l++){
+        m[l] = _mm_aesenc_si128(m[l], key_schedule[r]);
+      }
+    }
+    for (l = 0; l < n; l++){
+      m[l] = _mm_aesenclast_si128(m[l], key_schedule[10]);
+      len = buffer_out_size - i - l*AES_BLOCKLEN;
+      if (len >= AES_BLOCKLEN){
+        _mm_storeu_si128((__m128i*)&buffer_out[i + l*AES_BLOCKLEN], m[l]);
+      } else {
+        _mm_storeu_si128((__m128i*)block, m[l]);
+        memcpy(&buffer_out[i + l*AES_BLOCKLEN], block, len);
+      }
+    }
+  }
+}
+#endif
@@ -5,6 +5,9 @@
 //  - MP_owf_aes128_ni: Miyaguchi–Preneel one-way function with AES-NI.
 //  - G_tiny: G hash function with AES-128 standalone.
 //  - G_ni: G hash function with AES-128 (AES-NI).
+//  - G_ni_lanes: G_ni over up to AES_LANES independent inputs, interleaved.
+//  - G_fk_tiny/G_fk_ni/G_fk_ni_lanes: fixed-key AES PRG, same interface as G_*.
+//  - AES_CTR_tiny/AES_CTR_ni: AES-128 keystream in counter mode, for bulk sampling.
 // 
 // Author: Alberto Ibarrondo
 //
@@ -24,6 +27,9 @@
 
 #ifdef __AES__
 #include <wmmintrin.h>  //for intrinsics for AES-NI
+#ifdef __SSSE3__
+#include <tmmintrin.h>  //for _mm_shuffle_epi8
+#endif
 #endif
 
 // DEFINES
@@ -36,6 +42,9 @@
 #define Nr 10       // The number of rounds in AES Cipher.
 //  -NI-
 #define AES_128_key_exp(k, rcon) aes_128_key_expansion(k, _mm_aeskeygenassist_si128(k, rcon))
+#ifndef AES_LANES
+#define AES_LANES 8             // Independent blocks in flight in G_ni_lanes
+#endif
 
 //----------------------------------------------------------------------------//
 //--------------------------------- PUBLIC -----------------------------------//
@@ -67,6 +76,45 @@ void G_tiny(const uint8_t buffer_in[],   uint8_t buffer_out[],
 #ifdef __AES__
 void G_ni(const uint8_t buffer_in[],   uint8_t buffer_out[],
                  size_t buffer_in_size, size_t buffer_out_size);
+
+/*  G_ni_lanes: G_ni applied to n<=AES_LANES independent inputs at once. The AES
+       rounds of all lanes are interleaved, hiding the latency of AES-NI.
+    Input:  buffer_in  (n*16 bytes, one 16 byte input per lane)
+    Output: buffer_out (n*buffer_out_size bytes, lane l at l*buffer_out_size)
+*/
+void G_ni_lanes(size_t n, const uint8_t buffer_in[], uint8_t buffer_out[],
+                size_t buffer_out_size);
+#endif // AES-NI
+
+/*  G_fk: Fixed-key AES Pseudo-random generator. Output block j is H(in^j), with
+       H(x) = pi(x)^x the correlation-robust hash built from the AES-128 permutation
+       pi under a fixed public key, whose round keys are expanded only once. The
+       blocks are independent of each other, unlike the chained G above.
+       Outputs differ from G_tiny/G_ni: keys generated with one PRG must be
+       evaluated with the same PRG.
+    Input:  buffer_in  (16 bytes)
+    Output: buffer_out (n*16 bytes) for n integer, n<=256
+*/
+void G_fk_tiny(const uint8_t buffer_in[],   uint8_t buffer_out[],
+                   size_t buffer_in_size, size_t buffer_out_size);
+#ifdef __AES__
+void G_fk_ni(const uint8_t buffer_in[],   uint8_t buffer_out[],
+                 size_t buffer_in_size, size_t buffer_out_size);
+void G_fk_ni_lanes(size_t n, const uint8_t buffer_in[], uint8_t buffer_out[],
+                   size_t buffer_out_size);
+#endif // AES-NI
+
+/*  AES_CTR: AES-128 in counter mode. Block j of the output is AES_key(ctr+j), with
+       the counter taken as a little-endian 128-bit integer. The counter is left
+       after the last block used, so consecutive calls continue the same stream.
+    Input:  key (16 bytes), ctr (16 bytes, updated)
+    Output: buffer_out (buffer_out_size bytes, any length)
+*/
+void AES_CTR_tiny(const uint8_t key[AES_BLOCKLEN], uint8_t ctr[AES_BLOCKLEN],
+                  uint8_t buffer_out[], size_t buffer_out_size);
+#ifdef __AES__
+void AES_CTR_ni(const uint8_t key[AES_BLOCKLEN], uint8_t ctr[AES_BLOCKLEN],
+                uint8_t buffer_out[], size_t buffer_out_size);
 #endif // AES-NI
 
 #endif // __AES_H__
\ No newline at end of file
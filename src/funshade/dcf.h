@@ -0,0 +1,366 @@
+// DCF and MSB gates over an N-bit input domain and an unsigned output ring O
+// -----------------------------------------------------------------------------
+// Same construction as DCF_gen/DCF_eval in fss.h, but the tree has only as many
+//  levels as the input domain has bits, so small domains need proportionally
+//  fewer AES calls and shorter keys. Keys are laid out compactly, with the two
+//  control bits of every level packed into one bit string:
+//      s (S_LEN) | N x [s_cw (S_LEN) | v_cw (V_LEN)] | t_cw bits | v_cw_n+1 (V_LEN)
+//  The PRG of the tree is the one selected with DCF_set_prg(). The control bits
+//  are the low bits of the expanded seeds, which are then cleared, so that
+//  G only has to produce 2 seeds and 2 values: 3 AES blocks for any O up to 64 bits.
+//
+// Public templates:
+//  - DCF_gate<N, O>: o0 + o1 = beta*(x<alpha) for N-bit unsigned x and alpha.
+//  - MSB_gate<N, O>: o0 + o1 = MSB(x_hat-alpha), exact for any x_hat and alpha.
+//    Taking x = x_hat-alpha as a N-bit two's complement value, it gives (x<0).
+//    eval_thresholds() gives (x<t_1), ..., (x<t_m) for public t_j from one key,
+//    walking the parts of the tree shared by the points x_hat-t_j only once;
+//    eval_thresholds_batch() does so for many keys through the AES lanes.
+
+#ifndef __DCF_H__
+#define __DCF_H__
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include "fss.h"
+
+template <size_t N, class O>
+struct DCF_gate {
+    static_assert(N >= 1 && N <= 64, "the input domain must have between 1 and 64 bits");
+    static_assert(std::is_unsigned<O>::value, "the output ring must be an unsigned integer type");
+
+    static constexpr size_t S_LEN_ = S_LEN;
+    static constexpr size_t V_LEN_ = sizeof(O);
+    static constexpr size_t G_OUT = CEIL(2*S_LEN_+2*V_LEN_, G_IN_LEN)*G_IN_LEN;
+    static constexpr size_t CW_LEN_ = S_LEN_ + V_LEN_;
+    static constexpr size_t T_LEN = CEIL(2*N, 8);
+    static constexpr size_t CW_PTR_(size_t j) { return S_LEN_ + j*CW_LEN_; }
+    static constexpr size_t T_PTR = S_LEN_ + N*CW_LEN_;
+    static constexpr size_t LAST_CW_PTR_ = T_PTR + T_LEN;
+    static constexpr size_t KEY_LEN_ = LAST_CW_PTR_ + V_LEN_;
+    static constexpr uint64_t DOMAIN_MASK = (N == 64) ? ~0ULL : ((1ULL << N) - 1);
+
+    /// @brief Generate n<=AES_LANES/2 key pairs from the given initial states
+    /// @param alpha    n comparison points (only the low N bits are used)
+    /// @param beta     n output values
+    /// @param k0, k1   n pointers each, to the KEY_LEN_ bytes of the keys of party 0 and 1
+    /// @param s0, s1   n initial states of party 0 and 1, S_LEN bytes each
+    static void gen_lanes(size_t n, const uint64_t alpha[], const O beta[], uint8_t *k0[], uint8_t *k1[],
+                          const uint8_t s0[], const uint8_t s1[]) {
+        // States of party 0 are in lanes [0, n), those of party 1 in lanes [n, 2n)
+        uint8_t s[AES_LANES*S_LEN_] = {}, g_out[AES_LANES*G_OUT], s_cw[S_LEN_];
+        O V_alpha[AES_LANES/2] = {0}, V_cw;
+        bool t0[AES_LANES/2], t1[AES_LANES/2];
+        size_t i, l;
+        for (l = 0; l < n; l++) {
+            memcpy(&s[l*S_LEN_], &s0[l*S_LEN_], S_LEN_);
+            memcpy(&s[(n+l)*S_LEN_], &s1[l*S_LEN_], S_LEN_);
+            memcpy(k0[l], &s0[l*S_LEN_], S_LEN_);
+            memcpy(k1[l], &s1[l*S_LEN_], S_LEN_);
+            memset(&k0[l][T_PTR], 0, T_LEN);
+            t0[l] = 0;  t1[l] = 1;
+        }
+        for (i = 0; i < N; i++) {
+            G_prg_lanes(2*n, s, g_out, G_OUT);
+            for (l = 0; l < n; l++) {
+                uint8_t *g0 = &g_out[l*G_OUT], *g1 = &g_out[(n+l)*G_OUT];
+                bool a_bit = (alpha[l] >> (N-1-i)) & 1;
+                bool t0_g[2], t1_g[2], t_cw_L, t_cw_R;
+                split_t(g0, t0_g);  split_t(g1, t1_g);
+                size_t keep = a_bit, lose = !a_bit;     // 0: left, 1: right
+
+                myxor(g0 + S_PTR_(lose), g1 + S_PTR_(lose), s_cw, S_LEN_);
+                V_cw = sign(t1[l], V_(g1, lose) - V_(g0, lose) - V_alpha[l]);
+                V_cw += a_bit ? sign(t1[l], beta[l]) : O(0);
+                V_alpha[l] += V_(g0, keep) - V_(g1, keep) + sign(t1[l], V_cw);
+                t_cw_L = t0_g[0] ^ t1_g[0] ^ a_bit ^ 1;
+                t_cw_R = t0_g[1] ^ t1_g[1] ^ a_bit;
+
+                memcpy(&k0[l][CW_PTR_(i)], s_cw, S_LEN_);
+                memcpy(&k0[l][CW_PTR_(i)+S_LEN_], &V_cw, V_LEN_);
+                k0[l][T_PTR + (2*i)/8]   |= t_cw_L << ((2*i)%8);
+                k0[l][T_PTR + (2*i+1)/8] |= t_cw_R << ((2*i+1)%8);
+
+                xor_cond(g0 + S_PTR_(keep), s_cw, &s[l*S_LEN_], S_LEN_, t0[l]);
+                t0[l] = t0_g[keep] ^ (t0[l] & (a_bit ? t_cw_R : t_cw_L));
+                xor_cond(g1 + S_PTR_(keep), s_cw, &s[(n+l)*S_LEN_], S_LEN_, t1[l]);
+                t1[l] = t1_g[keep] ^ (t1[l] & (a_bit ? t_cw_R : t_cw_L));
+            }
+        }
+        for (l = 0; l < n; l++) {
+            O last = sign(t1[l], to_O(&s[(n+l)*S_LEN_]) - to_O(&s[l*S_LEN_]) - V_alpha[l]);
+            memcpy(&k0[l][LAST_CW_PTR_], &last, V_LEN_);
+            memcpy(&k1[l][S_LEN_], &k0[l][S_LEN_], KEY_LEN_ - S_LEN_);
+        }
+    }
+
+    /// @brief Evaluate n<=AES_LANES keys of party b, one tree level of all keys at a time
+    static void eval_lanes(size_t n, bool b, const uint8_t *kb[], const uint64_t x_hat[], O out[]) {
+        uint8_t s[AES_LANES*S_LEN_] = {}, g_out[AES_LANES*G_OUT];
+        O V[AES_LANES] = {0};
+        bool t[AES_LANES];
+        size_t i, l;
+        for (l = 0; l < n; l++) {
+            memcpy(&s[l*S_LEN_], kb[l], S_LEN_);
+            t[l] = b;
+        }
+        for (i = 0; i < N; i++) {
+            G_prg_lanes(n, s, g_out, G_OUT);
+            for (l = 0; l < n; l++) {
+                const uint8_t *k = kb[l];
+                uint8_t *g = &g_out[l*G_OUT];
+                size_t x_bit = (x_hat[l] >> (N-1-i)) & 1;
+                bool t_g[2];
+                split_t(g, t_g);
+                bool t_cw = (k[T_PTR + (2*i+x_bit)/8] >> ((2*i+x_bit)%8)) & 1;
+                V[l] += sign(b, V_(g, x_bit) + (t[l] ? to_O(&k[CW_PTR_(i)+S_LEN_]) : O(0)));
+                xor_cond(g + S_PTR_(x_bit), &k[CW_PTR_(i)], &s[l*S_LEN_], S_LEN_, t[l]);
+                t[l] = t_g[x_bit] ^ (t[l] & t_cw);
+            }
+        }
+        for (l = 0; l < n; l++) {
+            out[l] = V[l] + sign(b, to_O(&s[l*S_LEN_]) + (t[l] ? to_O(&kb[l][LAST_CW_PTR_]) : O(0)));
+        }
+    }
+
+    /// @brief Evaluate one key of party b at m points. Points are sorted so that those
+    ///  sharing a prefix are contiguous, and every tree node is expanded only once.
+    static void eval_points(bool b, const uint8_t kb[], size_t m, const uint64_t x[], O out[]) {
+        eval_points_lanes(1, b, &kb, m, &x, &out);
+    }
+
+    /// @brief Same as eval_points for n keys, key l at the m points x[l] into out[l]. The
+    ///  nodes of all keys at a level go through the AES lanes together.
+    static void eval_points_lanes(size_t n, bool b, const uint8_t *kb[], size_t m, const uint64_t *x[], O *out[]) {
+        // node of the tree of a key reached by its points idx[lo..hi)
+        struct node { size_t key, lo, hi; bool t; O V; };
+        std::vector<size_t> idx(n*m);
+        std::vector<node> nodes, next;
+        std::vector<uint8_t> s, s_next;
+        uint8_t g_out[AES_LANES*G_OUT];
+        size_t i, c, l, j;
+        if (m == 0) return;
+        for (l = 0; l < n; l++) {
+            const uint64_t *xl = x[l];
+            for (j = 0; j < m; j++) idx[l*m+j] = j;
+            std::sort(&idx[l*m], &idx[l*m+m],
+                      [&](size_t a, size_t c) { return (xl[a] & DOMAIN_MASK) < (xl[c] & DOMAIN_MASK); });
+            nodes.push_back({l, l*m, l*m+m, b, O(0)});
+            s.insert(s.end(), kb[l], kb[l] + S_LEN_);
+        }
+        for (i = 0; i < N; i++) {
+            next.clear();   s_next.clear();
+            for (c = 0; c < nodes.size(); c += AES_LANES) {
+                size_t lanes = (nodes.size()-c < AES_LANES) ? nodes.size()-c : AES_LANES;
+                G_prg_lanes(lanes, &s[c*S_LEN_], g_out, G_OUT);
+                for (l = 0; l < lanes; l++) {
+                    const node &nd = nodes[c+l];
+                    const uint8_t *k = kb[nd.key];
+                    const uint64_t *xk = x[nd.key];
+                    uint8_t *g = &g_out[l*G_OUT];
+                    bool t_g[2];
+                    split_t(g, t_g);
+                    size_t mid = nd.lo;
+                    while (mid < nd.hi && !((xk[idx[mid]] >> (N-1-i)) & 1)) mid++;
+                    for (size_t x_bit = 0; x_bit < 2; x_bit++) {
+                        size_t lo = x_bit ? mid : nd.lo, hi = x_bit ? nd.hi : mid;
+                        if (lo == hi) continue;
+                        bool t_cw = (k[T_PTR + (2*i+x_bit)/8] >> ((2*i+x_bit)%8)) & 1;
+                        O V = nd.V + sign(b, V_(g, x_bit) + (nd.t ? to_O(&k[CW_PTR_(i)+S_LEN_]) : O(0)));
+                        s_next.resize(s_next.size() + S_LEN_);
+                        xor_cond(g + S_PTR_(x_bit), &k[CW_PTR_(i)], &s_next[s_next.size()-S_LEN_], S_LEN_, nd.t);
+                        next.push_back({nd.key, lo, hi, bool(t_g[x_bit] ^ (nd.t & t_cw)), V});
+                    }
+                }
+            }
+            nodes.swap(next);   s.swap(s_next);
+        }
+        for (c = 0; c < nodes.size(); c++) {
+            const uint8_t *k = kb[nodes[c].key];
+            O o = nodes[c].V + sign(b, to_O(&s[c*S_LEN_]) + (nodes[c].t ? to_O(&k[LAST_CW_PTR_]) : O(0)));
+            for (j = nodes[c].lo; j < nodes[c].hi; j++) out[nodes[c].key][idx[j]] = o;
+        }
+    }
+
+    static void gen(uint64_t alpha, O beta, uint8_t k0[], uint8_t k1[]) {
+        uint8_t s0[S_LEN_], s1[S_LEN_];
+        random_buffer(s0, S_LEN_);
+        random_buffer(s1, S_LEN_);
+        gen_lanes(1, &alpha, &beta, &k0, &k1, s0, s1);
+    }
+
+    static O eval(bool b, const uint8_t kb[], uint64_t x_hat) {
+        O out;
+        eval_lanes(1, b, &kb, &x_hat, &out);
+        return out;
+    }
+
+ private:
+    static constexpr size_t S_PTR_(size_t right) { return right ? S_R_PTR : S_L_PTR; }
+    static O to_O(const uint8_t *ptr) { O v; memcpy(&v, ptr, V_LEN_); return v; }
+    static O V_(const uint8_t *g, size_t right) { return to_O(g + 2*S_LEN_ + right*V_LEN_); }
+    // takes the control bits of both children out of their seeds
+    static void split_t(uint8_t *g, bool t[2]) {
+        t[0] = g[S_L_PTR] & 0x01;   g[S_L_PTR] &= 0xFE;
+        t[1] = g[S_R_PTR] & 0x01;   g[S_R_PTR] &= 0xFE;
+    }
+    static O sign(bool negate, O v) { return negate ? O(0) - v : v; }
+};
+
+// Fewest thresholds per key for which MSB_gate::eval_thresholds_batch shares the tree of the
+// key among them. Measured with test_fss on 24-bit keys: about 10% faster than eval_batch
+// from 4 thresholds on, as fast at 2 and 20% slower at 1.
+#ifndef MSB_SHARED_TREE_MIN_POINTS
+#define MSB_SHARED_TREE_MIN_POINTS 4
+#endif
+
+template <size_t N, class O>
+struct MSB_gate {
+    static_assert(N >= 2, "the MSB gate needs at least 2 input bits");
+    // The borrow of the low N-1 bits, scaled by (1-2*MSB(alpha)), plus shares of MSB(alpha)
+    using Borrow = DCF_gate<N-1, O>;
+    static constexpr size_t Z_PTR_ = Borrow::KEY_LEN_;
+    static constexpr size_t KEY_LEN_ = Borrow::KEY_LEN_ + sizeof(O);
+    static constexpr uint64_t DOMAIN_MASK = DCF_gate<N, O>::DOMAIN_MASK;
+
+    /// @brief Generate n<=AES_LANES/2 key pairs from the given randomness
+    /// @param alpha    n input masks (only the low N bits are used)
+    /// @param k0, k1   n pointers each, to the KEY_LEN_ bytes of the keys of party 0 and 1
+    /// @param s0, s1   n initial states of party 0 and 1, S_LEN bytes each
+    /// @param z0       n random values, party 0's shares of MSB(alpha)
+    static void gen_lanes(size_t n, const uint64_t alpha[], uint8_t *k0[], uint8_t *k1[],
+                          const uint8_t s0[], const uint8_t s1[], const O z0[]) {
+        uint64_t alpha_low[AES_LANES/2];
+        O beta[AES_LANES/2], z1;
+        size_t l;
+        for (l = 0; l < n; l++) {
+            bool c = (alpha[l] >> (N-1)) & 1;
+            alpha_low[l] = alpha[l] & Borrow::DOMAIN_MASK;
+            beta[l] = c ? O(0) - O(1) : O(1);
+            z1 = O(c) - z0[l];
+            memcpy(&k0[l][Z_PTR_], &z0[l], sizeof(O));
+            memcpy(&k1[l][Z_PTR_], &z1, sizeof(O));
+        }
+        Borrow::gen_lanes(n, alpha_low, beta, k0, k1, s0, s1);
+    }
+
+    /// @brief Evaluate n<=AES_LANES keys of party b
+    static void eval_lanes(size_t n, bool b, const uint8_t *kb[], const uint64_t x_hat[], O out[]) {
+        uint64_t x_low[AES_LANES];
+        size_t l;
+        for (l = 0; l < n; l++) {
+            x_low[l] = x_hat[l] & Borrow::DOMAIN_MASK;
+        }
+        Borrow::eval_lanes(n, b, kb, x_low, out);
+        for (l = 0; l < n; l++) {
+            out[l] = from_borrow(b, kb[l], x_hat[l], out[l]);
+        }
+    }
+
+    /// @brief Shares of (x<t_j) for j<m, where x = x_hat-alpha, from one key of party b
+    /// @param t        m public thresholds, exact as long as every |x-t_j| < 2^(N-1)
+    static void eval_thresholds(bool b, const uint8_t kb[], uint64_t x_hat, size_t m, const uint64_t t[], O out[]) {
+        const uint64_t *t_ptr = t;
+        eval_thresholds_batch(1, b, kb, &x_hat, m, &t_ptr, out);
+    }
+
+    /// @brief eval_thresholds for K keys of party b stored contiguously, key k at x_hat[k] and
+    ///  the m thresholds t[k], giving out[k*m .. k*m+m). Below MSB_SHARED_TREE_MIN_POINTS
+    ///  thresholds, sharing the tree saves less than it costs, and the K*m points are evaluated
+    ///  independently like eval_batch. Otherwise the tree of every key is walked once for all
+    ///  its points, the nodes of AES_LANES keys going through the lanes together.
+    static void eval_thresholds_batch(size_t K, bool b, const uint8_t kb[], const uint64_t x_hat[], size_t m,
+                                      const uint64_t *t[], O out[]) {
+        if (m < MSB_SHARED_TREE_MIN_POINTS) {
+            const uint8_t *k_ptr[AES_LANES];
+            uint64_t x[AES_LANES];
+            size_t n = 0, first = 0;
+            for (size_t k = 0; k < K; k++) {
+                for (size_t j = 0; j < m; j++) {
+                    k_ptr[n] = &kb[k*KEY_LEN_];
+                    x[n++] = x_hat[k] - t[k][j];
+                    if (n == AES_LANES || (k == K-1 && j == m-1)) {
+                        eval_lanes(n, b, k_ptr, x, &out[first]);
+                        first += n;
+                        n = 0;
+                    }
+                }
+            }
+            return;
+        }
+        std::vector<uint64_t> y_low(AES_LANES*m);
+        const uint8_t *k_ptr[AES_LANES];
+        const uint64_t *y_ptr[AES_LANES];
+        O *o_ptr[AES_LANES];
+        for (size_t k = 0; k < K; k += AES_LANES) {
+            size_t n = (K-k < AES_LANES) ? K-k : AES_LANES;
+            for (size_t l = 0; l < n; l++) {
+                for (size_t j = 0; j < m; j++) {
+                    y_low[l*m+j] = (x_hat[k+l] - t[k+l][j]) & Borrow::DOMAIN_MASK;
+                }
+                k_ptr[l] = &kb[(k+l)*KEY_LEN_];
+                y_ptr[l] = &y_low[l*m];
+                o_ptr[l] = &out[(k+l)*m];
+            }
+            Borrow::eval_points_lanes(n, b, k_ptr, m, y_ptr, o_ptr);
+            for (size_t l = 0; l < n; l++) {
+                for (size_t j = 0; j < m; j++) {
+                    o_ptr[l][j] = from_borrow(b, k_ptr[l], x_hat[k+l] - t[k+l][j], o_ptr[l][j]);
+                }
+            }
+        }
+    }
+
+    /// @brief Generate K key pairs, sampling the randomness first
+    static void gen_batch(size_t K, const uint64_t alpha[], uint8_t *k0[], uint8_t *k1[]) {
+        uint8_t *s0 = (uint8_t*)malloc(K*S_LEN), *s1 = (uint8_t*)malloc(K*S_LEN);
+        O *z0 = (O*)malloc(K*sizeof(O));
+        random_buffer(s0, K*S_LEN);
+        random_buffer(s1, K*S_LEN);
+        random_buffer((uint8_t*)z0, K*sizeof(O));
+        gen_batch_seeded(K, alpha, k0, k1, s0, s1, z0);
+        free(s0); free(s1); free(z0);
+    }
+
+    static void gen_batch_seeded(size_t K, const uint64_t alpha[], uint8_t *k0[], uint8_t *k1[],
+                                 const uint8_t s0[], const uint8_t s1[], const O z0[]) {
+        for (size_t k = 0; k < K; k += AES_LANES/2) {
+            size_t n = (K-k < AES_LANES/2) ? K-k : AES_LANES/2;
+            gen_lanes(n, &alpha[k], &k0[k], &k1[k], &s0[k*S_LEN], &s1[k*S_LEN], &z0[k]);
+        }
+    }
+
+    static O eval(bool b, const uint8_t kb[], uint64_t x_hat) {
+        O out;
+        eval_lanes(1, b, &kb, &x_hat, &out);
+        return out;
+    }
+
+    /// @brief Evaluate K keys of party b, stored contiguously
+    static void eval_batch(size_t K, bool b, const uint8_t kb[], const uint64_t x_hat[], O out[]) {
+        size_t k;
+#if defined(_OPENMP)
+        #pragma omp parallel for
+#endif
+        for (k = 0; k < K; k += AES_LANES) {
+            const uint8_t *k_ptr[AES_LANES];
+            size_t n = (K-k < AES_LANES) ? K-k : AES_LANES;
+            for (size_t l = 0; l < n; l++) {
+                k_ptr[l] = &kb[(k+l)*KEY_LEN_];
+            }
+            eval_lanes(n, b, k_ptr, &x_hat[k], &out[k]);
+        }
+    }
+
+ private:
+    // u = MSB(alpha) xor borrow, then MSB(x) = MSB(x_hat) xor u
+    static O from_borrow(bool b, const uint8_t kb[], uint64_t x_hat, O borrow) {
+        O z, u;
+        memcpy(&z, &kb[Z_PTR_], sizeof(O));
+        u = borrow + z;
+        return ((x_hat >> (N-1)) & 1) ? O(b) - u : u;
+    }
+};
+
+#endif // __DCF_H__
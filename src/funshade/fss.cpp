@@ -37,6 +37,57 @@ void init_libsodium(){
             exit(EXIT_FAILURE);
         }
 }
+#else
+// Per-thread AES-CTR sampler. Its key and initial counter are drawn once per
+//  thread from the CPU entropy source, and small requests are served from a pool
+//  refilled in bulk, so that the key schedule is amortised over many calls.
+#define RAND_POOL_LEN 4096
+struct ctr_sampler {
+    uint8_t key[AES_BLOCKLEN], ctr[AES_BLOCKLEN];
+    uint8_t pool[RAND_POOL_LEN];
+    size_t pos;
+    bool init;
+};
+static thread_local struct ctr_sampler sampler = {{0}, {0}, {0}, RAND_POOL_LEN, false};
+
+static void aes_ctr(const uint8_t key[AES_BLOCKLEN], uint8_t ctr[AES_BLOCKLEN], uint8_t buffer[], size_t buffer_len){
+    #ifdef __AES__
+        AES_CTR_ni(key, ctr, buffer, buffer_len);
+    #else
+        AES_CTR_tiny(key, ctr, buffer, buffer_len);
+    #endif
+}
+
+// Fills the buffer from RDSEED (or RDRAND), falling back to /dev/urandom
+static void entropy_buffer(uint8_t buffer[], size_t buffer_len){
+    size_t i = 0;
+    #if defined(__RDSEED__) || defined(__RDRND__)
+        unsigned long long word;
+        int retries;
+        for (; i + sizeof(word) <= buffer_len; i += sizeof(word)){
+            for (retries = 0; retries < 1024; retries++){
+                #if defined(__RDSEED__)
+                    if (_rdseed64_step(&word)) break;
+                #else
+                    if (_rdrand64_step(&word)) break;
+                #endif
+                _mm_pause();
+            }
+            if (retries == 1024) break;
+            memcpy(&buffer[i], &word, sizeof(word));
+        }
+    #endif
+    if (i < buffer_len)
+    {
+        FILE *f = fopen("/dev/urandom", "rb");
+        if (f == NULL || fread(&buffer[i], 1, buffer_len - i, f) != buffer_len - i)
+        {
+            printf("<Funshade Error>: no entropy source available\n");
+            exit(EXIT_FAILURE);
+        }
+        fclose(f);
+    }
+}
 #endif
 
 void random_buffer_seeded(uint8_t buffer[], size_t buffer_len, const uint8_t seed[SEED_LEN]){
@@ -55,18 +106,38 @@ void random_buffer_seeded(uint8_t buffer[], size_t buffer_len, const uint8_t see
         {
             randombytes_buf_deterministic(buffer, buffer_len, seed);
         }
-    #else               // Use insecure random number generation
-        if (seed == NULL)
+    #else               // AES-128 in counter mode
+        if (seed == NULL)   // Per-thread stream keyed from the CPU entropy source
         {
-            srand((unsigned int)time(NULL));        // Initialize random seed
+            if (!sampler.init)
+            {
+                entropy_buffer(sampler.key, AES_BLOCKLEN);
+                entropy_buffer(sampler.ctr, AES_BLOCKLEN);
+                sampler.init = true;
+            }
+            if (buffer_len >= RAND_POOL_LEN)
+            {
+                aes_ctr(sampler.key, sampler.ctr, buffer, buffer_len);
+                return;
+            }
+            size_t taken, len;
+            for (taken = 0; taken < buffer_len; taken += len)
+            {
+                if (sampler.pos == RAND_POOL_LEN)
+                {
+                    aes_ctr(sampler.key, sampler.ctr, sampler.pool, RAND_POOL_LEN);
+                    sampler.pos = 0;
+                }
+                len = (buffer_len - taken < RAND_POOL_LEN - sampler.pos) ? buffer_len - taken : RAND_POOL_LEN - sampler.pos;
+                memcpy(&buffer[taken], &sampler.pool[sampler.pos], len);
+                sampler.pos += len;
+            }
         }
-        else
+        else                // Deterministic stream: key and counter from the seed
         {
-            srand(*((unsigned int*)seed));        // Initialize seeded
-        }
-        size_t i;
-        for (i = 0; i < buffer_len; i++){
-            buffer[i] = rand() % 256;
+            uint8_t ctr[AES_BLOCKLEN];
+            memcpy(ctr, &seed[AES_BLOCKLEN], AES_BLOCKLEN);
+            aes_ctr(seed, ctr, buffer, buffer_len);
         }
     #endif
 }
@@ -76,30 +147,7 @@ void random_buffer(uint8_t buffer[], size_t buffer_len){
 
 R_t random_dtype_seeded(const uint8_t seed[SEED_LEN]){
     R_t value = 0;
-    #ifdef USE_LIBSODIUM // Secure random number generation using libsodium
-        init_libsodium();
-        if (seed == NULL)   // If seed is not provided, use secure randomness
-        {
-            randombytes_buf(&value, sizeof(R_t));
-        }
-        else                // Use provided seed
-        {
-            randombytes_buf_deterministic(&value, sizeof(R_t), seed);
-        }
-    #else               // Use insecure random number generation
-        if (seed != NULL)   // If seed is not provided, use secure randomness
-        {
-            srand(*((unsigned int*)seed));        // Initialize seeded
-        }
-        else                // Use provided seed
-        {
-            srand((unsigned int)time(NULL));        // Initialize random seed
-        }
-        size_t i;
-        for (i = 0; i < sizeof(R_t); i++){
-            value = (R_t)rand();
-        }
-    #endif
+    random_buffer_seeded((uint8_t*)&value, sizeof(R_t), seed);
     return value;
 }
 R_t random_dtype(){
@@ -109,6 +157,50 @@ R_t random_dtype(){
 // -------------------------------------------------------------------------- //
 // ----------------- DISTRIBUTED COMPARISON FUNCTION (DCF) ------------------ //
 // -------------------------------------------------------------------------- //
+static int dcf_prg = DCF_PRG;
+
+void DCF_set_prg(int prg){
+    if (prg!=DCF_PRG_MP && prg!=DCF_PRG_FIXED_KEY)
+    {
+        printf("<Funshade Error>: unknown DCF PRG %d\n", prg);
+        exit(EXIT_FAILURE);
+    }
+    dcf_prg = prg;
+}
+int DCF_get_prg(){
+    return dcf_prg;
+}
+
+// Expands a DCF state into the G_OUT_LEN bytes of one tree level
+static void G_dcf(const uint8_t s[S_LEN], uint8_t g_out[G_OUT_LEN]){
+    #ifdef __AES__
+        if (dcf_prg==DCF_PRG_FIXED_KEY) { G_fk_ni(s, g_out, G_IN_LEN, G_OUT_LEN); }
+        else                            { G_ni(s, g_out, G_IN_LEN, G_OUT_LEN);    }
+    #else
+        if (dcf_prg==DCF_PRG_FIXED_KEY) { G_fk_tiny(s, g_out, G_IN_LEN, G_OUT_LEN); }
+        else                            { G_tiny(s, g_out, G_IN_LEN, G_OUT_LEN);    }
+    #endif
+}
+
+void G_prg_lanes(size_t n, const uint8_t s[], uint8_t g_out[], size_t g_out_len){
+    #ifdef __AES__
+        if (dcf_prg==DCF_PRG_FIXED_KEY) { G_fk_ni_lanes(n, s, g_out, g_out_len); }
+        else                            { G_ni_lanes(n, s, g_out, g_out_len);    }
+    #else
+        size_t l;
+        for (l = 0; l < n; l++)
+        {
+            if (dcf_prg==DCF_PRG_FIXED_KEY) { G_fk_tiny(&s[l*S_LEN], &g_out[l*g_out_len], G_IN_LEN, g_out_len); }
+            else                            { G_tiny(&s[l*S_LEN], &g_out[l*g_out_len], G_IN_LEN, g_out_len);    }
+        }
+    #endif
+}
+
+// Expands n<=AES_LANES states at once, interleaving their AES work when AES-NI is available
+static void G_dcf_lanes(size_t n, const uint8_t s[], uint8_t g_out[]){
+    G_prg_lanes(n, s, g_out, G_OUT_LEN);
+}
+
 void DCF_gen_seeded(R_t alpha, uint8_t k0[KEY_LEN], uint8_t k1[KEY_LEN], uint8_t s0[S_LEN], uint8_t s1[S_LEN]){
     // Inputs and outputs to G
     uint8_t s0_i[S_LEN],  g_out_0[G_OUT_LEN],
@@ -143,13 +235,8 @@ void DCF_gen_seeded(R_t alpha, uint8_t k0[KEY_LEN], uint8_t k1[KEY_LEN], uint8_t
     // Main loop
     for (i = 0; i < N_BITS; i++)                                         // L4
     {
-        #ifdef __AES__
-            G_ni(s0_i, g_out_0, G_IN_LEN, G_OUT_LEN);                           // L5
-            G_ni(s1_i, g_out_1, G_IN_LEN, G_OUT_LEN);                           // L6
-        #else
-            G_tiny(s0_i, g_out_0, G_IN_LEN, G_OUT_LEN);                         // L5
-            G_tiny(s1_i, g_out_1, G_IN_LEN, G_OUT_LEN);                         // L6
-        #endif
+        G_dcf(s0_i, g_out_0);                                                   // L5
+        G_dcf(s1_i, g_out_1);                                                   // L6
         t0_L = TO_BOOL(g_out_0 + T_L_PTR);   t0_R = TO_BOOL(g_out_0 + T_R_PTR);
         t1_L = TO_BOOL(g_out_1 + T_L_PTR);   t1_R = TO_BOOL(g_out_1 + T_R_PTR);
         if (alpha_bits[i])  // keep = R; lose = L;                              // L8
@@ -197,6 +284,84 @@ void DCF_gen(R_t alpha, uint8_t k0[KEY_LEN], uint8_t k1[KEY_LEN]){
     DCF_gen_seeded(alpha, k0, k1, NULL, NULL);
 }
 
+// Generates n<=AES_LANES/2 key pairs in lockstep: the states of both parties of
+// every key are expanded together, one tree level per G_dcf_lanes call
+static void DCF_gen_lanes(size_t n, const R_t alpha[], uint8_t *k0[], uint8_t *k1[],
+    const uint8_t s0[], const uint8_t s1[]){
+    // States of party 0 are in lanes [0, n), those of party 1 in lanes [n, 2n)
+    uint8_t s[AES_LANES*S_LEN], g_out[AES_LANES*G_OUT_LEN], s_cw[S_LEN];
+    const uint8_t *g0, *g1;
+    uint8_t *cw;
+    R_t V_cw, V_alpha[AES_LANES/2] = {0};
+    bool t0[AES_LANES/2], t1[AES_LANES/2], a_bit, t_cw_L, t_cw_R;
+    size_t i, l, s_keep, s_lose, v_keep, v_lose, t_keep;
+    for (l = 0; l < n; l++)
+    {
+        memcpy(&s[l*S_LEN], &s0[l*S_LEN], S_LEN);
+        memcpy(&s[(n+l)*S_LEN], &s1[l*S_LEN], S_LEN);
+        memcpy(&k0[l][S_PTR], &s0[l*S_LEN], S_LEN);
+        memcpy(&k1[l][S_PTR], &s1[l*S_LEN], S_LEN);
+        t0[l] = 0;  t1[l] = 1;
+    }
+    for (i = 0; i < N_BITS; i++)
+    {
+        G_dcf_lanes(2*n, s, g_out);
+        for (l = 0; l < n; l++)
+        {
+            g0 = &g_out[l*G_OUT_LEN];   g1 = &g_out[(n+l)*G_OUT_LEN];
+            a_bit = (US(alpha[l]) >> (N_BITS-i-1)) & 1;
+            s_keep = a_bit?S_R_PTR:S_L_PTR;     s_lose = a_bit?S_L_PTR:S_R_PTR;
+            v_keep = a_bit?V_R_PTR:V_L_PTR;     v_lose = a_bit?V_L_PTR:V_R_PTR;
+            t_keep = a_bit?T_R_PTR:T_L_PTR;
+
+            myxor(g0+s_lose, g1+s_lose, s_cw, S_LEN);
+            V_cw = (t1[l]?-1:1) * (TO_R_t(g1+v_lose) - TO_R_t(g0+v_lose) - V_alpha[l]);
+            V_cw += a_bit * (t1[l]?-1:1) * BETA;
+            V_alpha[l] += TO_R_t(g0+v_keep) - TO_R_t(g1+v_keep) + (t1[l]?-1:1)*V_cw;
+            t_cw_L = TO_BOOL(g0+T_L_PTR) ^ TO_BOOL(g1+T_L_PTR) ^ a_bit ^ 1;
+            t_cw_R = TO_BOOL(g0+T_R_PTR) ^ TO_BOOL(g1+T_R_PTR) ^ a_bit;
+
+            cw = &k0[l][CW_CHAIN_PTR];
+            memcpy(cw + S_CW_PTR(i), s_cw, S_LEN);
+            memcpy(cw + V_CW_PTR(i), &V_cw, V_LEN);
+            memcpy(cw + T_CW_L_PTR(i), &t_cw_L, sizeof(bool));
+            memcpy(cw + T_CW_R_PTR(i), &t_cw_R, sizeof(bool));
+
+            xor_cond(g0+s_keep, s_cw, &s[l*S_LEN], S_LEN, t0[l]);
+            t0[l] = TO_BOOL(g0+t_keep) ^ (t0[l] & (a_bit?t_cw_R:t_cw_L));
+            xor_cond(g1+s_keep, s_cw, &s[(n+l)*S_LEN], S_LEN, t1[l]);
+            t1[l] = TO_BOOL(g1+t_keep) ^ (t1[l] & (a_bit?t_cw_R:t_cw_L));
+        }
+    }
+    for (l = 0; l < n; l++)
+    {
+        V_alpha[l] = (t1[l]?-1:1) * (TO_R_t(&s[(n+l)*S_LEN]) - TO_R_t(&s[l*S_LEN]) - V_alpha[l]);
+        memcpy(&k0[l][CW_CHAIN_PTR+LAST_CW_PTR], &V_alpha[l], sizeof(R_t));
+        memcpy(&k1[l][CW_CHAIN_PTR], &k0[l][CW_CHAIN_PTR], CW_CHAIN_LEN);
+    }
+}
+
+void DCF_gen_batch_seeded(size_t K, const R_t alpha[], uint8_t *k0[], uint8_t *k1[],
+    const uint8_t s0[], const uint8_t s1[]){
+    size_t k;
+#if defined(_OPENMP)
+    #pragma omp parallel for
+#endif
+    for (k=0; k<K; k+=AES_LANES/2)
+    {
+        size_t n = (K-k < AES_LANES/2) ? K-k : AES_LANES/2;
+        DCF_gen_lanes(n, &alpha[k], &k0[k], &k1[k], &s0[k*S_LEN], &s1[k*S_LEN]);
+    }
+}
+void DCF_gen_batch(size_t K, const R_t alpha[], uint8_t *k0[], uint8_t *k1[]){
+    // All initial states are sampled up front, the generation itself is deterministic
+    uint8_t *s0 = (uint8_t*)malloc(K*S_LEN), *s1 = (uint8_t*)malloc(K*S_LEN);
+    random_buffer(s0, K*S_LEN);
+    random_buffer(s1, K*S_LEN);
+    DCF_gen_batch_seeded(K, alpha, k0, k1, s0, s1);
+    free(s0); free(s1);
+}
+
 R_t DCF_eval(bool b, const uint8_t kb[KEY_LEN], R_t x_hat){
     R_t V = 0;     bool t = b, x_bits[N_BITS];                                  // L1
     uint8_t s[S_LEN], g_out[G_OUT_LEN];     
@@ -209,11 +374,7 @@ R_t DCF_eval(bool b, const uint8_t kb[KEY_LEN], R_t x_hat){
     // Main loop
     for (i = 0; i < N_BITS; i++)                                         // L2
     {
-        #ifdef __AES__
-            G_ni(s, g_out, G_IN_LEN, G_OUT_LEN);                                // L4
-        #else
-            G_tiny(s, g_out, G_IN_LEN, G_OUT_LEN);
-        #endif
+        G_dcf(s, g_out);                                                        // L4
         if (x_bits[i]==0)  // Pick the Left branch
         {
            V += (b?-1:1) * (  TO_R_t(&g_out[V_L_PTR]) +                         // L7
@@ -233,6 +394,76 @@ R_t DCF_eval(bool b, const uint8_t kb[KEY_LEN], R_t x_hat){
     return V;
 }
 
+// Evaluates n<=AES_LANES keys in lockstep, one tree level of every key per G_ni_lanes call
+static void DCF_eval_lanes(size_t n, bool b, const uint8_t kb[], const R_t x_hat[], R_t out[]){
+    R_t V[AES_LANES] = {0};     bool t[AES_LANES], x_bit;
+    uint8_t s[AES_LANES*S_LEN], g_out[AES_LANES*G_OUT_LEN];
+    const uint8_t *k, *g;
+    size_t i, l;
+    for (l = 0; l < n; l++)
+    {
+        memcpy(&s[l*S_LEN], &kb[l*KEY_LEN+S_PTR], S_LEN);
+        t[l] = b;
+    }
+    for (i = 0; i < N_BITS; i++)
+    {
+        G_dcf_lanes(n, s, g_out);
+        for (l = 0; l < n; l++)
+        {
+            k = &kb[l*KEY_LEN];     g = &g_out[l*G_OUT_LEN];
+            x_bit = (US(x_hat[l]) >> (N_BITS-i-1)) & 1;
+            V[l] += (b?-1:1) * (  TO_R_t(&g[x_bit?V_R_PTR:V_L_PTR]) +
+                               t[l]*TO_R_t(&k[CW_CHAIN_PTR+V_CW_PTR(i)]));
+            xor_cond(g+(x_bit?S_R_PTR:S_L_PTR), &k[CW_CHAIN_PTR+S_CW_PTR(i)], &s[l*S_LEN], S_LEN, t[l]);
+            t[l] = TO_BOOL(g+(x_bit?T_R_PTR:T_L_PTR)) ^
+                   (t[l]&TO_BOOL(&k[CW_CHAIN_PTR+(x_bit?T_CW_R_PTR(i):T_CW_L_PTR(i))]));
+        }
+    }
+    for (l = 0; l < n; l++)
+    {
+        k = &kb[l*KEY_LEN];
+        out[l] = V[l] + (b?-1:1) * (TO_R_t(&s[l*S_LEN]) + t[l]*TO_R_t(&k[CW_CHAIN_PTR+LAST_CW_PTR]));
+    }
+}
+
+void DCF_eval_batch(size_t K, bool b, const uint8_t kb[], const R_t x_hat[], R_t out[]){
+    size_t k;
+#if defined(_OPENMP)
+    #pragma omp parallel for
+#endif
+    for (k=0; k<K; k+=AES_LANES)
+    {
+        size_t n = (K-k < AES_LANES) ? K-k : AES_LANES;
+        DCF_eval_lanes(n, b, &kb[k*KEY_LEN], &x_hat[k], &out[k]);
+    }
+}
+
+void DCF_key_compress(const uint8_t kb[KEY_LEN], uint8_t c_kb[C_KEY_LEN]){
+    size_t i;
+    memcpy(&c_kb[S_PTR], &kb[S_PTR], S_LEN);
+    memset(&c_kb[C_T_PTR], 0, C_T_LEN);
+    for (i = 0; i < N_BITS; i++)
+    {
+        memcpy(&c_kb[C_CW_PTR(i)], &kb[CW_CHAIN_PTR+S_CW_PTR(i)], S_LEN+V_LEN);
+        c_kb[C_T_PTR + (2*i)/8]   |= TO_BOOL(&kb[CW_CHAIN_PTR+T_CW_L_PTR(i)]) << ((2*i)%8);
+        c_kb[C_T_PTR + (2*i+1)/8] |= TO_BOOL(&kb[CW_CHAIN_PTR+T_CW_R_PTR(i)]) << ((2*i+1)%8);
+    }
+    memcpy(&c_kb[C_LAST_CW_PTR], &kb[CW_CHAIN_PTR+LAST_CW_PTR], V_LEN);
+}
+
+void DCF_key_expand(const uint8_t c_kb[C_KEY_LEN], uint8_t kb[KEY_LEN]){
+    size_t i;
+    memcpy(&kb[S_PTR], &c_kb[S_PTR], S_LEN);
+    for (i = 0; i < N_BITS; i++)
+    {
+        memcpy(&kb[CW_CHAIN_PTR+S_CW_PTR(i)], &c_kb[C_CW_PTR(i)], S_LEN+V_LEN);
+        kb[CW_CHAIN_PTR+T_CW_L_PTR(i)] = (c_kb[C_T_PTR + (2*i)/8]   >> ((2*i)%8))   & 0x01;
+        kb[CW_CHAIN_PTR+T_CW_R_PTR(i)] = (c_kb[C_T_PTR + (2*i+1)/8] >> ((2*i+1)%8)) & 0x01;
+    }
+    memcpy(&kb[CW_CHAIN_PTR+LAST_CW_PTR], &c_kb[C_LAST_CW_PTR], V_LEN);
+    memset(&kb[Z_PTR], 0, V_LEN);
+}
+
 // -------------------------------------------------------------------------- //
 // ------------------------- INTERVAL CONTAINMENT --------------------------- //
 // -------------------------------------------------------------------------- //
@@ -275,12 +506,24 @@ void SIGN_gen_batch(size_t K, R_t theta, R_t r_in_0[], R_t r_in_1[], uint8_t k0[
 R_t SIGN_eval(bool b, const uint8_t kb[KEY_LEN], R_t x_hat){
     return IC_eval(b, 0, (R_t)((1ULL<<(N_BITS-1))-1), kb, x_hat);
 }
+// Both DCF evaluations of every key go through the interleaved DCF_eval_batch
 void SIGN_eval_batch(size_t K, bool b, const uint8_t kb[], const R_t x_hat[], R_t ob[]){
+    R_t p = 0, q = (R_t)((1ULL<<(N_BITS-1))-1);
+    R_t *x_1 = (R_t*)malloc(K*sizeof(R_t)), *x_2 = (R_t*)malloc(K*sizeof(R_t)),
+        *o_1 = (R_t*)malloc(K*sizeof(R_t)), *o_2 = (R_t*)malloc(K*sizeof(R_t));
     size_t k;
     for (k=0; k<K; k++)
     {
-        ob[k] = SIGN_eval(b, &kb[k*KEY_LEN], x_hat[k]);
+        x_1[k] = x_hat[k]-p-1;
+        x_2[k] = x_hat[k]-q-2;
+    }
+    DCF_eval_batch(K, b, kb, x_1, o_1);
+    DCF_eval_batch(K, b, kb, x_2, o_2);
+    for (k=0; k<K; k++)
+    {
+        ob[k] = b*((US(x_hat[k])>US(p))-(US(x_hat[k])>US(q+1))) - o_1[k] + o_2[k] + TO_R_t(&kb[k*KEY_LEN+Z_PTR]);
     }
+    free(x_1); free(x_2); free(o_1); free(o_2);
 }
 
 
@@ -366,17 +609,77 @@ void funshade_setup_batch(size_t K, size_t l, R_t theta,
     }
 }
 
+// Element-wise terms j*D_x*D_y - D_x*d_yj - D_y*d_xj + d_xyj of the scalar product
+static void dist_terms(size_t n, bool j, const R_t D_x[], const R_t D_y[],
+    const R_t d_xj[], const R_t d_yj[], const R_t d_xyj[], R_t out[])
+{
+    size_t i = 0;
+#if defined(SIMD_R_LANES)
+    if (sizeof(R_t) == sizeof(int32_t))
+    {
+    #if defined(__AVX512F__)
+        __m512i mask = _mm512_set1_epi32(j ? -1 : 0), Dx, Dy, t;
+        for (; i + SIMD_R_LANES <= n; i += SIMD_R_LANES)
+        {
+            Dx = _mm512_loadu_si512((const void*)&D_x[i]);
+            Dy = _mm512_loadu_si512((const void*)&D_y[i]);
+            t = _mm512_and_si512(_mm512_mullo_epi32(Dx, Dy), mask);
+            t = _mm512_sub_epi32(t, _mm512_mullo_epi32(Dx, _mm512_loadu_si512((const void*)&d_yj[i])));
+            t = _mm512_sub_epi32(t, _mm512_mullo_epi32(Dy, _mm512_loadu_si512((const void*)&d_xj[i])));
+            t = _mm512_add_epi32(t, _mm512_loadu_si512((const void*)&d_xyj[i]));
+            _mm512_storeu_si512((void*)&out[i], t);
+        }
+    #else
+        __m256i mask = _mm256_set1_epi32(j ? -1 : 0), Dx, Dy, t;
+        for (; i + SIMD_R_LANES <= n; i += SIMD_R_LANES)
+        {
+            Dx = _mm256_loadu_si256((const __m256i*)&D_x[i]);
+            Dy = _mm256_loadu_si256((const __m256i*)&D_y[i]);
+            t = _mm256_and_si256(_mm256_mullo_epi32(Dx, Dy), mask);
+            t = _mm256_sub_epi32(t, _mm256_mullo_epi32(Dx, _mm256_loadu_si256((const __m256i*)&d_yj[i])));
+            t = _mm256_sub_epi32(t, _mm256_mullo_epi32(Dy, _mm256_loadu_si256((const __m256i*)&d_xj[i])));
+            t = _mm256_add_epi32(t, _mm256_loadu_si256((const __m256i*)&d_xyj[i]));
+            _mm256_storeu_si256((__m256i*)&out[i], t);
+        }
+    #endif
+    }
+#endif
+    for (; i < n; i++)
+    {
+        out[i] = j*(D_x[i]*D_y[i]) - (D_x[i]*d_yj[i]) - (D_y[i]*d_xj[i]) + d_xyj[i];
+    }
+}
+
 void funshade_share_batch(size_t K, size_t l, const R_t v[], const R_t d_v[],
     R_t D_v[])
 {
-    size_t idx;
+    size_t start;
 
 #if defined(_OPENMP)
     #pragma omp parallel for
 #endif
-    for (idx=0; idx<K*l; idx++)
+    for (start=0; start<K*l; start+=DIST_BLOCK)
     {
-        D_v[idx] = d_v[idx] + v[idx];
+        size_t idx = start, end = (K*l-start < DIST_BLOCK) ? K*l : start+DIST_BLOCK;
+#if defined(SIMD_R_LANES)
+        if (sizeof(R_t) == sizeof(int32_t))
+        {
+            for (; idx + SIMD_R_LANES <= end; idx += SIMD_R_LANES)
+            {
+    #if defined(__AVX512F__)
+                _mm512_storeu_si512((void*)&D_v[idx], _mm512_add_epi32(
+                    _mm512_loadu_si512((const void*)&d_v[idx]), _mm512_loadu_si512((const void*)&v[idx])));
+    #else
+                _mm256_storeu_si256((__m256i*)&D_v[idx], _mm256_add_epi32(
+                    _mm256_loadu_si256((const __m256i*)&d_v[idx]), _mm256_loadu_si256((const __m256i*)&v[idx])));
+    #endif
+            }
+        }
+#endif
+        for (; idx<end; idx++)
+        {
+            D_v[idx] = d_v[idx] + v[idx];
+        }
     }
 }
 
@@ -384,43 +687,62 @@ void funshade_eval_dist_batch(size_t K, size_t l, bool j, const R_t r_in_j[],
     const R_t D_x[], const R_t D_y[], const R_t d_xj[], const R_t d_yj[],
     const R_t d_xyj[], R_t z_hat_j[])
 {
-    size_t k,i,idx;
-    memcpy(z_hat_j, r_in_j, K*sizeof(R_t));
+    // Blocks of whole inputs (or of one input, if it is longer than DIST_BLOCK): the
+    //  terms of a block are computed in vectors and then added up per input
+    size_t B = (l < DIST_BLOCK) ? DIST_BLOCK/l : 1, k_start;
+    if (l == 0)
+    {
+        memcpy(z_hat_j, r_in_j, K*sizeof(R_t));
+        return;
+    }
 #if defined(_OPENMP)
     #pragma omp parallel for
 #endif
-    for (k=0; k<K; k++)
+    for (k_start=0; k_start<K; k_start+=B)
     {
-        for (i=0; i<l; i++)
+        R_t terms[DIST_BLOCK];
+        size_t n_k = (K-k_start < B) ? K-k_start : B, k = k_start, pos = 0, i, t, n;
+        R_t acc = r_in_j[k];
+        for (i=0; i<n_k*l; i+=n)
         {
-            idx = k*l + i;
-            z_hat_j[k] += j*(D_x[idx]*D_y[idx]) - (D_x[idx]*d_yj[idx]) - (D_y[idx]*d_xj[idx]) + d_xyj[idx];
+            n = (n_k*l-i < DIST_BLOCK) ? n_k*l-i : DIST_BLOCK;
+            dist_terms(n, j, &D_x[k_start*l+i], &D_y[k_start*l+i], &d_xj[k_start*l+i],
+                       &d_yj[k_start*l+i], &d_xyj[k_start*l+i], terms);
+            for (t=0; t<n; t++)
+            {
+                acc += terms[t];
+                if (++pos == l)
+                {
+                    z_hat_j[k++] = acc;
+                    acc = (k < k_start+n_k) ? r_in_j[k] : 0;
+                    pos = 0;
+                }
+            }
         }
     }
 }
 
 void funshade_eval_sign_batch(size_t K, bool j, const uint8_t k_j[], const R_t z_hat_0[], const R_t z_hat_1[], R_t o_j[])
 {
+    R_t *z_hat = (R_t*)malloc(K*sizeof(R_t));
     size_t k;
-#if defined(_OPENMP)
-    #pragma omp parallel for
-#endif
     for (k=0; k<K; k++)
     {
-        o_j[k]= SIGN_eval(j, &k_j[k*KEY_LEN], z_hat_0[k]+z_hat_1[k]);
+        z_hat[k] = z_hat_0[k]+z_hat_1[k];
     }
+    SIGN_eval_batch(K, j, k_j, z_hat, o_j);
+    free(z_hat);
 }
 
 R_t funshade_eval_sign_batch_collapse(size_t K, bool j, const uint8_t k_j[], const R_t z_hat_0[], const R_t z_hat_1[])
 {
-    R_t o_j = 0;
+    R_t o_j = 0, *o = (R_t*)malloc(K*sizeof(R_t));
     size_t k;
-#if defined(_OPENMP)
-    #pragma omp parallel for
-#endif
+    funshade_eval_sign_batch(K, j, k_j, z_hat_0, z_hat_1, o);
     for (k=0; k<K; k++)
     {
-        o_j += SIGN_eval(j, &k_j[k*KEY_LEN], z_hat_0[k]+z_hat_1[k]);
+        o_j += o[k];
     }
+    free(o);
     return o_j;
 }
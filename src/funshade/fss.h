@@ -5,7 +5,7 @@
 #include <stdbool.h>    // bool, true, false
 #include <stdio.h>      // printf()
 #include <time.h>       // time()
-#include <stdlib.h>     // rand(), srand()
+#include <stdlib.h>     // malloc(), exit()
 
 //----------------------------------------------------------------------------//
 // DEPENDENCIES
@@ -20,6 +20,10 @@
     #include <omp.h>        // OpenMP header
 #endif
 
+#if defined(__RDSEED__) || defined(__RDRND__) || defined(__AVX2__)
+    #include <immintrin.h>  // _rdseed64_step(), _rdrand64_step(), AVX2/AVX-512
+#endif
+
 #include "aes.h" // AES-128-NI and AES-128-standalone
 
 //----------------------------------------------------------------------------//
@@ -30,6 +34,14 @@
 #define R_t             int32_t             // Ring data type for all the constructions
 #endif
 #define BETA            1                   // Value of the output of the FSS gate
+// PRG expanding the DCF tree. Keys can only be evaluated under the PRG they were
+//  generated with. The default can be overridden at build time (-DDCF_PRG=...)
+//  and at run time with DCF_set_prg().
+#define DCF_PRG_MP          0                   // Miyaguchi–Preneel chain, new AES key per block
+#define DCF_PRG_FIXED_KEY   1                   // Fixed-key AES correlation-robust hash
+#ifndef DCF_PRG
+#define DCF_PRG         DCF_PRG_MP
+#endif
 
 //----------------------------------------------------------------------------//
 //-------------------------------- PRIVATE -----------------------------------//
@@ -41,6 +53,13 @@
 
 // FIXED DEFINITIONS
 #define N_BITS          sizeof(R_t)*8                       // Number of bits in R_t
+// Elements of R_t per vector in the batch kernels of funshade, if R_t is 32-bit
+#if defined(__AVX512F__)
+    #define SIMD_R_LANES    16
+#elif defined(__AVX2__)
+    #define SIMD_R_LANES    8
+#endif
+#define DIST_BLOCK      1024                                // Elements per block in funshade_eval_dist_batch
 
 #define G_IN_LEN        CEIL(SEC_PARAM,8)                   // [SEC_PARAM/8] input bytes
 #define OUT_LEN         CEIL(2*SEC_PARAM+2*N_BITS+2,8)      // output bytes
@@ -76,10 +95,19 @@
 #define CW_CHAIN_PTR    (S_PTR + S_LEN)                     // Position of correction word chain
 #define Z_PTR           (CW_CHAIN_PTR + CW_CHAIN_LEN)       // Position of value z
 
+// Compact DCF key: the same state and correction words, with the two control bits
+//  of every level packed into a bit string after the chain, and without z (IC only)
+#define C_CW_LEN        (S_LEN + V_LEN)                     // Correction word without control bits
+#define C_T_LEN         CEIL(2*N_BITS,8)                    // Packed control bits, 2 per level
+#define C_KEY_LEN       (S_LEN + C_CW_LEN*N_BITS + C_T_LEN + V_LEN)  // Size of the compact DCF key
+#define C_CW_PTR(j)     (S_LEN + (j)*C_CW_LEN)              // Position of correction word j
+#define C_T_PTR         (S_LEN + C_CW_LEN*N_BITS)           // Position of the packed control bits
+#define C_LAST_CW_PTR   (C_T_PTR + C_T_LEN)                 // Position of last correction word, v_cw_n+1
+
 //----------------------------------------------------------------------------//
 //--------------------------------  PRIVATE  ---------------------------------//
 //----------------------------------------------------------------------------//
-void mxor(const uint8_t *a, const uint8_t *b, uint8_t *res, size_t s_len);
+void myxor(const uint8_t *a, const uint8_t *b, uint8_t *res, size_t s_len);
 void bit_decomposition(R_t value, bool *bits_array);
 void xor_cond(const uint8_t *a, const uint8_t *b, uint8_t *res, size_t len, bool cond);
 #ifdef USE_LIBSODIUM
@@ -90,8 +118,9 @@ void init_libsodium();
 //----------------------------------------------------------------------------//
 
 //.............................. RANDOMNESS GEN ..............................//
-// Manages randomness. Uses libsodium (cryptographically secure) if USE_LIBSODIUM
-//  is defined, otherwise uses rand() (not cryptographically secure but portable).
+// Manages randomness. Uses libsodium if USE_LIBSODIUM is defined, otherwise AES-128
+//  in counter mode, keyed per thread from RDSEED/RDRAND (or /dev/urandom). Seeded
+//  variants derive the AES key and counter from the SEED_LEN bytes of the seed.
 R_t random_dtype();                                    // Non-deterministic seed
 R_t random_dtype_seeded(const uint8_t seed[SEED_LEN]);
 void random_buffer(uint8_t buffer[], size_t buffer_len);   // Non-deterministic seed 
@@ -101,6 +130,16 @@ void random_buffer_seeded(uint8_t buffer[], size_t buffer_len, const uint8_t see
 // FSS gate for the Distributed Conditional Function (DCF) gate.
 //  Yields o0 + o1 = BETA*((unsigned)x>(unsigned)alpha)
 
+/// @brief Select the PRG of the DCF tree for all subsequent DCF_gen/DCF_eval calls
+/// @param prg      DCF_PRG_MP or DCF_PRG_FIXED_KEY
+void DCF_set_prg(int prg);
+int DCF_get_prg();
+
+/// @brief Expand n<=AES_LANES DCF states with the selected PRG, interleaving their AES work
+/// @param s        n states, S_LEN bytes each
+/// @param g_out    n outputs, g_out_len bytes each (multiple of G_IN_LEN)
+void G_prg_lanes(size_t n, const uint8_t s[], uint8_t g_out[], size_t g_out_len);
+
 /// @brief Generate a FSS key pair for the DCF gate
 /// @param alpha input mask (should be uniformly random in R_t)
 /// @param k0   pointer to the key of party 0
@@ -110,6 +149,17 @@ void random_buffer_seeded(uint8_t buffer[], size_t buffer_len, const uint8_t see
 void DCF_gen(R_t alpha, uint8_t k0[KEY_LEN], uint8_t k1[KEY_LEN]);
 void DCF_gen_seeded(R_t alpha, uint8_t k0[KEY_LEN], uint8_t k1[KEY_LEN], uint8_t s0[S_LEN], uint8_t s1[S_LEN]);
 
+/// @brief Generate K FSS key pairs for the DCF gate, interleaving the AES work of AES_LANES/2 pairs
+/// @param K        number of key pairs
+/// @param alpha    K input masks
+/// @param k0       K pointers, k0[k] receives the KEY_LEN bytes of the k-th key of party 0
+/// @param k1       K pointers, k1[k] receives the KEY_LEN bytes of the k-th key of party 1
+/// @param s0       K initial states of party 0, S_LEN bytes each (sampled if unspecified)
+/// @param s1       K initial states of party 1, S_LEN bytes each (sampled if unspecified)
+void DCF_gen_batch(size_t K, const R_t alpha[], uint8_t *k0[], uint8_t *k1[]);
+void DCF_gen_batch_seeded(size_t K, const R_t alpha[], uint8_t *k0[], uint8_t *k1[],
+    const uint8_t s0[], const uint8_t s1[]);
+
 /// @brief Evaluate the DCF gate for a given input x in a 2PC setting
 /// @param b        party number (0 or 1)
 /// @param kb       pointer to the key of the party
@@ -117,6 +167,24 @@ void DCF_gen_seeded(R_t alpha, uint8_t k0[KEY_LEN], uint8_t k1[KEY_LEN], uint8_t
 /// @return         result of the FSS gate o, such that o0 + o1 = BETA*((unsigned)x>(unsigned)alpha)
 R_t DCF_eval(bool b, const uint8_t kb[KEY_LEN], R_t x_hat);
 
+/// @brief Evaluate K independent DCF gates, interleaving AES_LANES keys per tree level
+/// @param K        number of keys and inputs
+/// @param b        party number (0 or 1)
+/// @param kb       pointer to the K keys of the party, KEY_LEN bytes each
+/// @param x_hat    K public inputs, x_hat[k] is evaluated with the k-th key
+/// @param out      K results, out[k] == DCF_eval(b, &kb[k*KEY_LEN], x_hat[k])
+void DCF_eval_batch(size_t K, bool b, const uint8_t kb[], const R_t x_hat[], R_t out[]);
+
+/// @brief Encode a DCF key into the compact C_KEY_LEN format, e.g. before sending it
+/// @param kb       key of the party (KEY_LEN bytes)
+/// @param c_kb     compact key (C_KEY_LEN bytes)
+void DCF_key_compress(const uint8_t kb[KEY_LEN], uint8_t c_kb[C_KEY_LEN]);
+
+/// @brief Decode a compact DCF key back into the KEY_LEN format taken by DCF_eval
+/// @param c_kb     compact key (C_KEY_LEN bytes)
+/// @param kb       key of the party (KEY_LEN bytes), z is set to 0
+void DCF_key_expand(const uint8_t c_kb[C_KEY_LEN], uint8_t kb[KEY_LEN]);
+
 
 //................................ IC GATE ...................................//
 
@@ -191,7 +259,10 @@ R_t funshade_eval_sign(bool j, const uint8_t kb[KEY_LEN], R_t z_hat);
 
 
 // BATCH EVALUATION
-//  Same as above, but for a batch of K inputs. Could use OpenMP to parallelize.
+//  Same as above, but for a batch of K inputs. The element-wise terms are computed
+//  with AVX2/AVX-512 when available, and the keys are parallelized with OpenMP if
+//  enabled. Inputs are independent, so callers may also split a batch into chunks
+//  of consecutive inputs and run them on their own threads.
 void funshade_setup_batch(size_t K, size_t l, R_t theta,
     R_t d_x0[], R_t d_x1[], R_t d_y0[], R_t d_y1[], R_t d_xy0[],R_t d_xy1[],
     R_t r_in_0[],R_t r_in_1[], uint8_t k0[], uint8_t k1[]);
@@ -7,6 +7,7 @@
 #define N_REPETITIONS 10    // number of repetitions for each test
 #define N_REF_DB 5000       // (K) number of embeddings in the reference database 
 #define EMBEDDING_LEN 512   // (l) Typically in {128, 256, 512} for face recog.
+#define N_DRIVERS 500       // (D) drivers compared against one rider, 2 DCF gates each
 
 //----------------------------------------------------------------------------//
 // DEPENDENCIES
@@ -15,6 +16,7 @@
 #include <stdio.h>  // printf
 #include <time.h>   // clock_gettime
 #include "fss.h"     // FSS functions
+#include "dcf.h"     // DCF and MSB gates over N-bit domains
 #include "aes.h"     // AES-128-NI and AES-128-tiny (standalone)
 
 
@@ -75,6 +77,37 @@ bool test_aes(int n_times) {
     return correct;
 }
 
+bool test_aes_fk(int n_times) {
+    uint8_t plain[AES_LANES*G_IN_LEN]={0}, hash_ni[G_OUT_LEN]={0}, hash_sa[G_OUT_LEN]={0},
+            hash_lanes[AES_LANES*G_OUT_LEN]={0};
+    double t_ni=0, t_sa=0;
+    int i, l;
+    bool correct = true;
+
+    for(i=0; i<n_times; i++){
+        // Generate random input
+        random_buffer(plain, AES_LANES*G_IN_LEN);
+
+        // Hash input with both implementations
+        tic();  G_fk_ni  (plain, hash_ni, G_IN_LEN, G_OUT_LEN); t_ni+= toc();
+        tic();  G_fk_tiny(plain, hash_sa, G_IN_LEN, G_OUT_LEN); t_sa+= toc();
+        correct &= (memcmp(hash_ni, hash_sa, sizeof(hash_ni)) == 0);
+
+        // Every lane of the interleaved version must match the single one
+        G_fk_ni_lanes(AES_LANES, plain, hash_lanes, G_OUT_LEN);
+        for (l=0; l<AES_LANES; l++){
+            G_fk_ni(&plain[l*G_IN_LEN], hash_ni, G_IN_LEN, G_OUT_LEN);
+            correct &= (memcmp(hash_ni, &hash_lanes[l*G_OUT_LEN], G_OUT_LEN) == 0);
+        }
+    }
+    printf("Test AES fixed-key fully correct: %s\n", correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Avg. time G_fk_ni:   %-5.0f (ns)\n", t_ni/n_times);
+        printf(" - Avg. time G_fk_tiny: %-5.0f (ns)\n", t_sa/n_times);
+    }
+    return correct;
+}
+
 bool test_dcf(int n_times) {
     double t_gen=0, t_eval=0;
     // Inputs and outputs to FSS gate
@@ -122,6 +155,326 @@ bool test_dcf(int n_times) {
     return correct;
 }
 
+bool test_dcf_batch(int n_times, size_t K){
+    double t_single=0, t_batch=0;
+    uint8_t *k0 = (uint8_t*)malloc(K*KEY_LEN), *k1 = (uint8_t*)malloc(K*KEY_LEN);
+    R_t *alpha = (R_t*)malloc(K*sizeof(R_t)),   *x = (R_t*)malloc(K*sizeof(R_t)),
+        *o0 = (R_t*)malloc(K*sizeof(R_t)),      *o1 = (R_t*)malloc(K*sizeof(R_t));
+    bool correct=true;
+    size_t k;
+    int i;
+
+    for (i=0; i<n_times; i++)
+    {
+        // Generate keys and inputs
+        random_buffer((uint8_t*)alpha, K*sizeof(R_t));
+        random_buffer((uint8_t*)x, K*sizeof(R_t));
+        for (k=0; k<K; k++){
+            DCF_gen(alpha[k], &k0[k*KEY_LEN], &k1[k*KEY_LEN]);
+        }
+
+        // Evaluate one key at a time, as the reference
+        tic();
+        for (k=0; k<K; k++){
+            o0[k] = DCF_eval(0, &k0[k*KEY_LEN], x[k]);
+        }
+        t_single += toc();
+
+        // Evaluate all keys together, must match the reference share by share
+        tic(); DCF_eval_batch(K, 1, k1, x, o1); t_batch += toc();
+        for (k=0; k<K; k++){
+            correct &= (DCF_eval(1, &k1[k*KEY_LEN], x[k]) == o1[k]);
+            correct &= ((unsigned)x[k]<(unsigned)alpha[k]) == (bool)(o0[k]+o1[k]);
+        }
+    }
+    printf("Test DCF batched fully correct: %s\n", correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Avg. time DCF_eval:        %-5.0f (ns)\n", t_single/(n_times*K));
+        printf(" - Avg. time DCF_eval_batch:  %-5.0f (ns)\n", t_batch/(n_times*K));
+    }
+    free(k0); free(k1); free(alpha); free(x); free(o0); free(o1);
+    return correct;
+}
+
+bool test_dcf_gen_batch(int n_times, size_t K){
+    double t_single=0, t_batch=0;
+    uint8_t *k0 = (uint8_t*)malloc(K*KEY_LEN),      *k1 = (uint8_t*)malloc(K*KEY_LEN),
+            *k0_b = (uint8_t*)malloc(K*KEY_LEN),    *k1_b = (uint8_t*)malloc(K*KEY_LEN),
+            *s0 = (uint8_t*)malloc(K*S_LEN),        *s1 = (uint8_t*)malloc(K*S_LEN);
+    uint8_t **k0_ptr = (uint8_t**)malloc(K*sizeof(uint8_t*)), **k1_ptr = (uint8_t**)malloc(K*sizeof(uint8_t*));
+    R_t *alpha = (R_t*)malloc(K*sizeof(R_t));
+    bool correct=true;
+    size_t k;
+    int i;
+
+    for (k=0; k<K; k++){
+        k0_ptr[k] = &k0_b[k*KEY_LEN];
+        k1_ptr[k] = &k1_b[k*KEY_LEN];
+    }
+    for (i=0; i<n_times; i++)
+    {
+        random_buffer((uint8_t*)alpha, K*sizeof(R_t));
+        random_buffer(s0, K*S_LEN);
+        random_buffer(s1, K*S_LEN);
+
+        // Generate one key pair at a time, as the reference
+        tic();
+        for (k=0; k<K; k++){
+            DCF_gen_seeded(alpha[k], &k0[k*KEY_LEN], &k1[k*KEY_LEN], &s0[k*S_LEN], &s1[k*S_LEN]);
+        }
+        t_single += toc();
+
+        // Same states must yield the same keys
+        tic(); DCF_gen_batch_seeded(K, alpha, k0_ptr, k1_ptr, s0, s1); t_batch += toc();
+        for (k=0; k<K; k++){
+            correct &= (memcmp(&k0[k*KEY_LEN], k0_ptr[k], S_LEN+CW_CHAIN_LEN) == 0);
+            correct &= (memcmp(&k1[k*KEY_LEN], k1_ptr[k], S_LEN+CW_CHAIN_LEN) == 0);
+        }
+    }
+    printf("Test DCF_gen batched fully correct: %s\n", correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Avg. time DCF_gen:        %-5.0f (ns)\n", t_single/(n_times*K));
+        printf(" - Avg. time DCF_gen_batch:  %-5.0f (ns)\n", t_batch/(n_times*K));
+    }
+    free(k0); free(k1); free(k0_b); free(k1_b); free(s0); free(s1);
+    free(k0_ptr); free(k1_ptr); free(alpha);
+    return correct;
+}
+
+bool test_dcf_prg(int n_times, size_t K){
+    double t_eval[2]={0}, t_batch[2]={0};
+    int prgs[2] = {DCF_PRG_MP, DCF_PRG_FIXED_KEY}, p, i;
+    uint8_t *k0 = (uint8_t*)malloc(K*KEY_LEN), *k1 = (uint8_t*)malloc(K*KEY_LEN);
+    R_t *alpha = (R_t*)malloc(K*sizeof(R_t)),   *x = (R_t*)malloc(K*sizeof(R_t)),
+        *o0 = (R_t*)malloc(K*sizeof(R_t)),      *o1 = (R_t*)malloc(K*sizeof(R_t));
+    bool correct=true;
+    size_t k;
+
+    for (p=0; p<2; p++)
+    {
+        // Keys are generated and evaluated under the same PRG
+        DCF_set_prg(prgs[p]);
+        for (i=0; i<n_times; i++)
+        {
+            random_buffer((uint8_t*)alpha, K*sizeof(R_t));
+            random_buffer((uint8_t*)x, K*sizeof(R_t));
+            for (k=0; k<K; k++){
+                DCF_gen(alpha[k], &k0[k*KEY_LEN], &k1[k*KEY_LEN]);
+            }
+            tic();
+            for (k=0; k<K; k++){
+                o0[k] = DCF_eval(0, &k0[k*KEY_LEN], x[k]);
+            }
+            t_eval[p] += toc();
+            tic(); DCF_eval_batch(K, 1, k1, x, o1); t_batch[p] += toc();
+            for (k=0; k<K; k++){
+                correct &= ((unsigned)x[k]<(unsigned)alpha[k]) == (bool)(o0[k]+o1[k]);
+            }
+        }
+    }
+    DCF_set_prg(DCF_PRG);
+    printf("Test DCF fixed-key PRG fully correct: %s\n", correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Avg. time DCF_eval (MP / fixed-key):        %-5.0f / %-5.0f (ns), x%.2f\n",
+            t_eval[0]/(n_times*K), t_eval[1]/(n_times*K), t_eval[0]/t_eval[1]);
+        printf(" - Avg. time DCF_eval_batch (MP / fixed-key):  %-5.0f / %-5.0f (ns), x%.2f\n",
+            t_batch[0]/(n_times*K), t_batch[1]/(n_times*K), t_batch[0]/t_batch[1]);
+    }
+    free(k0); free(k1); free(alpha); free(x); free(o0); free(o1);
+    return correct;
+}
+
+bool test_dcf_compact(int n_times){
+    R_t alpha, x, o0, o1;
+    uint8_t k0[KEY_LEN]={0}, k1[KEY_LEN]={0}, c_k0[C_KEY_LEN], c_k1[C_KEY_LEN],
+            k0_e[KEY_LEN], k1_e[KEY_LEN];
+    bool correct=true;
+    int i;
+
+    for (i=0; i<n_times; i++)
+    {
+        alpha = random_dtype();     x = random_dtype();
+        DCF_gen(alpha, k0, k1);
+        DCF_key_compress(k0, c_k0);     DCF_key_compress(k1, c_k1);
+        DCF_key_expand(c_k0, k0_e);     DCF_key_expand(c_k1, k1_e);
+
+        // The round trip keeps everything DCF_eval reads
+        correct &= (memcmp(k0, k0_e, S_LEN+CW_CHAIN_LEN) == 0);
+        correct &= (memcmp(k1, k1_e, S_LEN+CW_CHAIN_LEN) == 0);
+        o0 = DCF_eval(0, k0_e, x);      o1 = DCF_eval(1, k1_e, x);
+        correct &= ((unsigned)x<(unsigned)alpha) == (bool)(o0+o1);
+    }
+    printf("Test DCF compact keys fully correct: %s\n", correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Key size (KEY_LEN / C_KEY_LEN):  %lu / %lu (bytes)\n", (unsigned long)KEY_LEN, (unsigned long)C_KEY_LEN);
+    }
+    return correct;
+}
+
+template <size_t N, class O>
+bool test_dcf_gate(int n_times, size_t K){
+    typedef DCF_gate<N, O> DCF_N;
+    double t_eval=0;
+    uint8_t *k0 = (uint8_t*)malloc(DCF_N::KEY_LEN_), *k1 = (uint8_t*)malloc(DCF_N::KEY_LEN_);
+    uint64_t alpha, x;
+    O beta, o;
+    bool correct=true;
+    size_t k;
+    int i;
+
+    for (i=0; i<n_times; i++)
+    {
+        random_buffer((uint8_t*)&beta, sizeof(O));
+        for (k=0; k<K; k++){
+            random_buffer((uint8_t*)&alpha, sizeof(alpha));     alpha &= DCF_N::DOMAIN_MASK;
+            random_buffer((uint8_t*)&x, sizeof(x));             x &= DCF_N::DOMAIN_MASK;
+            if (k%4==0) { x = alpha; }                          // Boundaries of the comparison
+            if (k%4==1) { x = (alpha-1) & DCF_N::DOMAIN_MASK; }
+            DCF_N::gen(alpha, beta, k0, k1);
+            tic(); o = DCF_N::eval(0, k0, x) + DCF_N::eval(1, k1, x); t_eval += toc();
+            correct &= (o == (x<alpha ? beta : O(0)));
+        }
+    }
+    printf("Test DCF_gate<%lu, %lu> fully correct: %s\n", (unsigned long)N, (unsigned long)(8*sizeof(O)), correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Key size:              %-5lu (bytes)\n", (unsigned long)DCF_N::KEY_LEN_);
+        printf(" - Avg. time DCF_eval:    %-5.0f (ns)\n", t_eval/(n_times*K*2));
+    }
+    free(k0); free(k1);
+    return correct;
+}
+
+template <size_t N, class O>
+bool test_msb_gate(int n_times, size_t K){
+    typedef MSB_gate<N, O> MSB_N;
+    double t_batch=0;
+    uint8_t *k0 = (uint8_t*)malloc(K*MSB_N::KEY_LEN_), *k1 = (uint8_t*)malloc(K*MSB_N::KEY_LEN_);
+    uint8_t **k0_ptr = (uint8_t**)malloc(K*sizeof(uint8_t*)), **k1_ptr = (uint8_t**)malloc(K*sizeof(uint8_t*));
+    uint64_t *alpha = (uint64_t*)malloc(K*sizeof(uint64_t)), *x_hat = (uint64_t*)malloc(K*sizeof(uint64_t));
+    O *o0 = (O*)malloc(K*sizeof(O)), *o1 = (O*)malloc(K*sizeof(O));
+    bool correct=true;
+    size_t k;
+    int i;
+
+    for (k=0; k<K; k++){
+        k0_ptr[k] = &k0[k*MSB_N::KEY_LEN_];
+        k1_ptr[k] = &k1[k*MSB_N::KEY_LEN_];
+    }
+    for (i=0; i<n_times; i++)
+    {
+        random_buffer((uint8_t*)alpha, K*sizeof(uint64_t));
+        random_buffer((uint8_t*)x_hat, K*sizeof(uint64_t));
+        MSB_N::gen_batch(K, alpha, k0_ptr, k1_ptr);
+        tic(); MSB_N::eval_batch(K, 0, k0, x_hat, o0); t_batch += toc();
+        MSB_N::eval_batch(K, 1, k1, x_hat, o1);
+        for (k=0; k<K; k++){
+            uint64_t x = (x_hat[k]-alpha[k]) & MSB_N::DOMAIN_MASK;
+            correct &= (O(o0[k]+o1[k]) == O(x >> (N-1)));
+        }
+    }
+    printf("Test MSB_gate<%lu, %lu> fully correct: %s\n", (unsigned long)N, (unsigned long)(8*sizeof(O)), correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Key size:                    %-5lu (bytes)\n", (unsigned long)MSB_N::KEY_LEN_);
+        printf(" - Avg. time MSB eval_batch:    %-5.0f (ns)\n", t_batch/(n_times*K));
+    }
+    free(k0); free(k1); free(k0_ptr); free(k1_ptr); free(alpha); free(x_hat); free(o0); free(o1);
+    return correct;
+}
+
+template <size_t N, class O>
+bool test_msb_thresholds(int n_times, size_t K, size_t m){
+    typedef MSB_gate<N, O> MSB_N;
+    double t_batch=0, t_multi=0;
+    uint8_t *k0 = (uint8_t*)malloc(K*MSB_N::KEY_LEN_), *k1 = (uint8_t*)malloc(K*MSB_N::KEY_LEN_);
+    uint8_t *k_rep = (uint8_t*)malloc(K*m*MSB_N::KEY_LEN_);
+    uint8_t **k0_ptr = (uint8_t**)malloc(K*sizeof(uint8_t*)), **k1_ptr = (uint8_t**)malloc(K*sizeof(uint8_t*));
+    uint64_t *alpha = (uint64_t*)malloc(K*sizeof(uint64_t)), *x = (uint64_t*)malloc(K*sizeof(uint64_t));
+    uint64_t *x_hat = (uint64_t*)malloc(K*sizeof(uint64_t)), *y_hat = (uint64_t*)malloc(K*m*sizeof(uint64_t));
+    uint64_t *t = (uint64_t*)malloc(m*sizeof(uint64_t));
+    const uint64_t **t_ptr = (const uint64_t**)malloc(K*sizeof(uint64_t*));
+    O *o0 = (O*)malloc(K*m*sizeof(O)), *o1 = (O*)malloc(K*m*sizeof(O)), *o = (O*)malloc(K*m*sizeof(O));
+    bool correct=true;
+    size_t j, k;
+    int i;
+
+    // tiered thresholds: squared radii of 50, 100, 150, ... around a non-negative x
+    for (j=0; j<m; j++){
+        t[j] = (uint64_t)(50*(j+1))*(50*(j+1));
+    }
+    for (k=0; k<K; k++){
+        k0_ptr[k] = &k0[k*MSB_N::KEY_LEN_];
+        k1_ptr[k] = &k1[k*MSB_N::KEY_LEN_];
+        t_ptr[k] = t;
+    }
+    for (i=0; i<n_times; i++)
+    {
+        random_buffer((uint8_t*)alpha, K*sizeof(uint64_t));
+        random_buffer((uint8_t*)x, K*sizeof(uint64_t));
+        for (k=0; k<K; k++){
+            x[k] %= 2*t[m-1];
+            x_hat[k] = x[k]+alpha[k];
+        }
+        MSB_N::gen_batch(K, alpha, k0_ptr, k1_ptr);
+        tic(); MSB_N::eval_thresholds_batch(K, 0, k0, x_hat, m, t_ptr, o0); t_multi += toc();
+        MSB_N::eval_thresholds_batch(K, 1, k1, x_hat, m, t_ptr, o1);
+        for (k=0; k<K; k++){
+            for (j=0; j<m; j++){
+                correct &= (O(o0[k*m+j]+o1[k*m+j]) == O(x[k] < t[j]));
+            }
+        }
+        // the same comparisons as K*m independent keys
+        for (k=0; k<K*m; k++){
+            memcpy(&k_rep[k*MSB_N::KEY_LEN_], k0_ptr[k/m], MSB_N::KEY_LEN_);
+            y_hat[k] = x_hat[k/m]-t[k%m];
+        }
+        tic(); MSB_N::eval_batch(K*m, 0, k_rep, y_hat, o); t_batch += toc();
+        correct &= (memcmp(o, o0, K*m*sizeof(O)) == 0);
+        // one key at a time
+        MSB_N::eval_thresholds(1, k1, x_hat[0], m, t, o);
+        correct &= (memcmp(o, o1, m*sizeof(O)) == 0);
+    }
+    printf("Test MSB_gate<%lu, %lu> thresholds fully correct: %s\n", (unsigned long)N, (unsigned long)(8*sizeof(O)), correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Avg. time per key, %lu thresholds (eval_batch / eval_thresholds_batch): %-6.0f / %-6.0f (ns)\n",
+               (unsigned long)m, t_batch/(n_times*K), t_multi/(n_times*K));
+    }
+    free(k0); free(k1); free(k_rep); free(k0_ptr); free(k1_ptr); free(alpha); free(x); free(x_hat); free(y_hat);
+    free(t); free(t_ptr); free(o0); free(o1); free(o);
+    return correct;
+}
+
+bool test_random(int n_times){
+    const size_t len = 1<<20;
+    double t_bulk=0, t_small=0;
+    uint8_t *a = (uint8_t*)malloc(len), *b = (uint8_t*)malloc(len), seed[SEED_LEN];
+    bool correct=true;
+    size_t j;
+    int i;
+
+    for (i=0; i<n_times; i++)
+    {
+        // seeded streams are reproducible, unseeded ones are not
+        random_buffer(seed, SEED_LEN);
+        random_buffer_seeded(a, len, seed);
+        random_buffer_seeded(b, len, seed);
+        correct &= (memcmp(a, b, len) == 0);
+        tic(); random_buffer(a, len); t_bulk += toc();
+        tic();
+        for (j=0; j<len; j+=S_LEN){
+            random_buffer(&b[j], S_LEN);
+        }
+        t_small += toc();
+        correct &= (memcmp(a, b, len) != 0);
+        correct &= (random_dtype() != random_dtype() || random_dtype() != random_dtype());
+    }
+    printf("Test random_buffer fully correct: %s\n", correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Throughput bulk / %d-byte calls: %-6.0f / %-6.0f (MB/s)\n", S_LEN, n_times*len/(t_bulk/1e3), n_times*len/(t_small/1e3));
+    }
+    free(a); free(b);
+    return correct;
+}
+
 bool test_ic(int n_times){
     double t_gen=0, t_eval=0;
     // Inputs and outputs to FSS gate
@@ -187,14 +540,15 @@ bool test_funshade(size_t n_times, size_t l){
     for (i=0; i<n_times; i++)
     {
         // Generate random inputs
+        // |x|, |y| < 2^(N_BITS/2-1) and |x*y| < 2^(N_BITS-2)/l, so neither z nor z-theta wrap around
         z = 0;
         for (idx=0; idx<l; idx++){
-            x[idx] = random_dtype()/(2*l);
-            y[idx] = random_dtype()/(2*l);
+            x[idx] = random_dtype()/((R_t)1<<(N_BITS/2));
+            y[idx] = random_dtype()/((R_t)1<<(N_BITS/2))/(R_t)l;
             z += x[idx]*y[idx];
         }
         // Generate a random threshold
-        theta = random_dtype()/8; // theta in [0, 2^N_BITS/8]
+        theta = random_dtype()/8; // theta in [-2^N_BITS/16, 2^N_BITS/16]
 
         // Generate correlated randomness, input mask and fss keys
         tic(); funshade_setup(l, theta, r_in, d_x0, d_x1, d_y0, d_y1, d_xy0, d_xy1, k0, k1); t_setup += toc();
@@ -235,6 +589,47 @@ bool test_funshade(size_t n_times, size_t l){
     return correct;
 }
 
+bool test_funshade_kernels(size_t n_times, size_t l, size_t K){
+    size_t v_size = l*K, i, k;
+    R_t *D_x = (R_t*)malloc(v_size*sizeof(R_t)), *D_y = (R_t*)malloc(v_size*sizeof(R_t)),
+        *d_x = (R_t*)malloc(v_size*sizeof(R_t)), *d_y = (R_t*)malloc(v_size*sizeof(R_t)),
+        *d_xy= (R_t*)malloc(v_size*sizeof(R_t)), *r_in= (R_t*)malloc(K*sizeof(R_t)),
+        *z   = (R_t*)malloc(K*sizeof(R_t)),      *o   = (R_t*)malloc(K*sizeof(R_t));
+    uint8_t *k0 = (uint8_t*)malloc(K*KEY_LEN), *k1 = (uint8_t*)malloc(K*KEY_LEN);
+    double t_single=0, t_batch=0, t_sign_single=0, t_sign_batch=0;
+    bool correct=true;
+
+    for (i=0; i<n_times; i++)
+    {
+        random_buffer((uint8_t*)D_x, v_size*sizeof(R_t));   random_buffer((uint8_t*)D_y, v_size*sizeof(R_t));
+        random_buffer((uint8_t*)d_x, v_size*sizeof(R_t));   random_buffer((uint8_t*)d_y, v_size*sizeof(R_t));
+        random_buffer((uint8_t*)d_xy, v_size*sizeof(R_t));  random_buffer((uint8_t*)r_in, K*sizeof(R_t));
+        // the batch kernels give the same shares as the single evaluations
+        tic(); funshade_eval_dist_batch(K, l, 1, r_in, D_x, D_y, d_x, d_y, d_xy, z); t_batch += toc();
+        tic();
+        for (k=0; k<K; k++){
+            correct &= (z[k] == funshade_eval_dist(l, 1, r_in[k], &D_x[k*l], &D_y[k*l], &d_x[k*l], &d_y[k*l], &d_xy[k*l]));
+        }
+        t_single += toc();
+        for (k=0; k<K; k++){
+            SIGN_gen(r_in[k], 0, &k0[k*KEY_LEN], &k1[k*KEY_LEN]);
+        }
+        tic(); SIGN_eval_batch(K, 1, k1, z, o); t_sign_batch += toc();
+        tic();
+        for (k=0; k<K; k++){
+            correct &= (o[k] == SIGN_eval(1, &k1[k*KEY_LEN], z[k]));
+        }
+        t_sign_single += toc();
+    }
+    printf("Test Funshade kernels (l=%lu) fully correct: %s\n", (unsigned long)l, correct ? "true" : "false");
+    if (TIMEIT){
+        printf(" - Avg. time eval_dist (single / batch): %-6.0f / %-6.0f (ns)\n", t_single/(n_times*K), t_batch/(n_times*K));
+        printf(" - Avg. time SIGN_eval (single / batch): %-6.0f / %-6.0f (ns)\n", t_sign_single/(n_times*K), t_sign_batch/(n_times*K));
+    }
+    free(D_x); free(D_y); free(d_x); free(d_y); free(d_xy); free(r_in); free(z); free(o); free(k0); free(k1);
+    return correct;
+}
+
 bool test_funshade_batch(size_t n_times, size_t l, size_t K){
     // Allocate empty everything
     size_t v_size = l*K;
@@ -249,20 +644,23 @@ bool test_funshade_batch(size_t n_times, size_t l, size_t K){
     uint8_t *k0 = (uint8_t*)malloc(K*KEY_LEN), *k1 = (uint8_t*)malloc(K*KEY_LEN);
 
     double t_setup=0, t_share=0, t_eval_sp=0, t_eval_sign=0;
-    R_t *z     = (R_t*)calloc(v_size, sizeof(R_t));
-    R_t     o0, o1, o,                  // output of SIGN gate, should yield (z>=theta)
-            theta;                      // threshold
-    bool correct=true, res;
+    R_t *z     = (R_t*)malloc(K*sizeof(R_t)),
+        *o_0   = (R_t*)malloc(K*sizeof(R_t)),  *o_1 = (R_t*)malloc(K*sizeof(R_t));
+    R_t     o0, o1, o,                  // summed output of SIGN gates, should yield the count of (z>=theta)
+            theta,                      // threshold
+            res;
+    bool correct=true;
     size_t i, idx;
     
     for (i=0; i<n_times; i++)
     {
         // Generate random inputs
-        // z = 0;
+        // |x|, |y| < 2^(N_BITS/2-1) and |x*y| < 2^(N_BITS-2)/l, so neither z nor z-theta wrap around
+        memset(z, 0, K*sizeof(R_t));
         for (idx=0; idx<l*K; idx++){
-            x[idx] = random_dtype()/(2*l);
-            y[idx] = random_dtype()/(2*l);
-            z[idx/l] += x[i]*y[i];
+            x[idx] = random_dtype()/((R_t)1<<(N_BITS/2));
+            y[idx] = random_dtype()/((R_t)1<<(N_BITS/2))/(R_t)l;
+            z[idx/l] += x[idx]*y[idx];
         }
         // Generate a random threshold
         theta = random_dtype()/8; // theta in [0, 2^N_BITS/8]
@@ -286,12 +684,15 @@ bool test_funshade_batch(size_t n_times, size_t l, size_t K){
         tic(); o1 = funshade_eval_sign_batch_collapse(K, 1, k1, z_hat_0, z_hat_1); t_eval_sign+= toc();
         o = (o0 + o1);
 
-        // Check if the result is correct, print if not
+        // Check every comparison and their count
+        funshade_eval_sign_batch(K, 0, k0, z_hat_0, z_hat_1, o_0);
+        funshade_eval_sign_batch(K, 1, k1, z_hat_0, z_hat_1, o_1);
         res = 0;
         for (idx=0; idx<K; idx++){
             res += (z[idx]>=theta);
+            correct &= ((z[idx]>=theta) == (o_0[idx] + o_1[idx]));
         }
-        correct &= (res == (bool)o);
+        correct &= (res == o);
     }
     printf("Test Funshade batched fully correct: %s\n", correct ? "true" : "false");
     if (TIMEIT){
@@ -308,7 +709,7 @@ bool test_funshade_batch(size_t n_times, size_t l, size_t K){
     free(x); free(d_x); free(D_x); free(d_x0); free(d_x1); 
     free(y); free(d_y); free(D_y); free(d_y0); free(d_y1);
     free(d_xy0); free(d_xy1); free(r_in_0); free(r_in_1); free(z_hat_0); free(z_hat_1); free(k0); free(k1);
-    free(z);
+    free(z); free(o_0); free(o_1);
     return correct;
 }
 
@@ -317,10 +718,28 @@ bool test_funshade_batch(size_t n_times, size_t l, size_t K){
 int main() {
     bool correct=true;
     correct &= test_aes(N_REPETITIONS);
+    correct &= test_aes_fk(N_REPETITIONS);
     correct &= test_dcf(N_REPETITIONS);
+    correct &= test_dcf_batch(N_REPETITIONS, 2*N_DRIVERS);
+    correct &= test_dcf_gen_batch(N_REPETITIONS, 2*N_DRIVERS);
+    correct &= test_dcf_prg(N_REPETITIONS, 2*N_DRIVERS);
+    correct &= test_dcf_compact(N_REPETITIONS);
+    correct &= test_dcf_gate<32, uint32_t>(N_REPETITIONS, 100);
+    correct &= test_dcf_gate<8, uint64_t>(N_REPETITIONS, 100);
+    correct &= test_dcf_gate<64, uint8_t>(N_REPETITIONS, 100);
+    correct &= test_msb_gate<24, uint64_t>(N_REPETITIONS, 2*N_DRIVERS);
+    correct &= test_msb_gate<2, uint64_t>(N_REPETITIONS, 100);
+    correct &= test_random(N_REPETITIONS);
+    correct &= test_msb_thresholds<24, uint64_t>(N_REPETITIONS, 2*N_DRIVERS, 1);
+    correct &= test_msb_thresholds<24, uint64_t>(N_REPETITIONS, 2*N_DRIVERS, 4);
+    correct &= test_msb_thresholds<24, uint64_t>(N_REPETITIONS, 2*N_DRIVERS, 16);
+    correct &= test_msb_thresholds<24, uint64_t>(N_REPETITIONS, 2*N_DRIVERS, 32);
     correct &= test_ic(N_REPETITIONS);
     correct &= test_funshade(N_REPETITIONS, 1);
     correct &= test_funshade(N_REPETITIONS, EMBEDDING_LEN);
+    correct &= test_funshade_kernels(N_REPETITIONS, 4, 2*N_DRIVERS);
+    correct &= test_funshade_kernels(N_REPETITIONS, EMBEDDING_LEN, 100);
+    correct &= test_funshade_kernels(N_REPETITIONS, 3*DIST_BLOCK/2, 10);
     correct &= test_funshade_batch(N_REPETITIONS, EMBEDDING_LEN, N_REF_DB);
     if (correct)
     {
@@ -328,5 +747,5 @@ int main() {
     } else {
         printf("Tests failed. \n");
     }        
-    exit(0);
+    exit(correct ? 0 : 1);
 }
@@ -135,6 +135,15 @@ NetIOMP::NetIOMP(int party, int nP, int port, char* IP[], bool localhost)
     return res;
   }
 
+  std::vector<uint64_t> NetIOMP::countPerParty() {
+    std::vector<uint64_t> res(nP, 0);
+    for (int i = 0; i < nP; ++i)
+      if (i != party && ios[i] && ios2[i]) {
+        res[i] = ios[i]->counter + ios2[i]->counter;
+      }
+    return res;
+  }
+
   void NetIOMP::resetStats() {
     for (int i = 0; i < nP; ++i) {
       if (i != party) {
@@ -142,6 +151,7 @@ NetIOMP::NetIOMP(int party, int nP, int port, char* IP[], bool localhost)
         ios2[i]->counter = 0;
       }
     }
+    rounds = 0;
   }
 
   void NetIOMP::send(int dst, const void* data, size_t len) {
@@ -151,6 +161,7 @@ NetIOMP::NetIOMP(int party, int nP, int port, char* IP[], bool localhost)
       else
         ios2[dst]->send_data(data, len);
       sent[dst] = true;
+      sending = true;
     }
     #ifdef __clang__
         flush(dst);
@@ -198,6 +209,9 @@ NetIOMP::NetIOMP(int party, int nP, int port, char* IP[], bool localhost)
   void NetIOMP::recv(int src, void* data, size_t len) {
     if (src != -1 && src != party) {
       if (sent[src]) flush(src);
+      if (sending.exchange(false)) {
+        rounds++;
+      }
       if (src < party)
         ios[src]->recv_data(data, len);
       else
@@ -28,6 +28,7 @@
 #pragma once
 
 #include <emp-tool/emp-tool.h>
+#include <atomic>
 #include <vector>
 
 #include "types.h"
@@ -44,6 +45,11 @@ class NetIOMP {
   int party;
   int nP;
   std::vector<bool> sent;
+  // number of communication rounds seen by this party, counted as turnarounds from sending to receiving;
+  // atomic so that, once everything sent has been flushed, different sources can be received from
+  // on different threads
+  std::atomic<uint64_t> rounds{0};
+  std::atomic<bool> sending{false};
 
   NetIOMP(int party, int nP, int port, char* IP[], bool localhost = false);
 
@@ -51,6 +57,9 @@ class NetIOMP {
 
   int64_t count();
 
+  // bytes sent to each party so far
+  std::vector<uint64_t> countPerParty();
+
   void resetStats();
 
   void send(int dst, const void* data, size_t len);
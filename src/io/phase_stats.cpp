@@ -0,0 +1,57 @@
+#include "phase_stats.h"
+
+namespace io {
+
+void PhaseRecorder::add(const PhaseStats& stats) {
+  for (auto& phase : phases_) {
+    if (phase.name == stats.name) {
+      phase.time += stats.time;
+      phase.rounds += stats.rounds;
+      phase.communication.resize(std::max(phase.communication.size(), stats.communication.size()), 0);
+      for (size_t i = 0; i < stats.communication.size(); ++i) {
+        phase.communication[i] += stats.communication[i];
+      }
+      return;
+    }
+  }
+  phases_.push_back(stats);
+}
+
+const std::vector<PhaseStats>& PhaseRecorder::phases() const {
+  return phases_;
+}
+
+void PhaseRecorder::clear() {
+  phases_.clear();
+}
+
+ScopedPhase::ScopedPhase(PhaseRecorder* recorder, NetIOMP& network, std::string name)
+    : recorder_(recorder), network_(network) {
+  if (recorder_ == nullptr) {
+    return;
+  }
+  stats_.name = std::move(name);
+  stats_.communication = network_.countPerParty();
+  stats_.rounds = network_.rounds;
+  start_ = clock_type::now();
+}
+
+void ScopedPhase::stop() {
+  if (recorder_ == nullptr) {
+    return;
+  }
+  stats_.time = std::chrono::duration<double, std::milli>(clock_type::now() - start_).count();
+  auto end_comm = network_.countPerParty();
+  for (size_t i = 0; i < end_comm.size(); ++i) {
+    stats_.communication[i] = end_comm[i] - stats_.communication[i];
+  }
+  stats_.rounds = network_.rounds - stats_.rounds;
+  recorder_->add(stats_);
+  recorder_ = nullptr;
+}
+
+ScopedPhase::~ScopedPhase() {
+  stop();
+}
+
+};  // namespace io
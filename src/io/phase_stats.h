@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "netmp.h"
+
+namespace io {
+
+// Time, bytes sent to each party and communication rounds spent in one phase of a protocol.
+struct PhaseStats {
+  std::string name;
+  double time = 0;  // in milliseconds
+  std::vector<uint64_t> communication;
+  uint64_t rounds = 0;
+};
+
+// Collects the statistics of the phases of a protocol run. Phases recorded several
+// times under the same name (e.g. once per tile) are accumulated into one entry,
+// kept in the order in which they were first seen.
+class PhaseRecorder {
+  std::vector<PhaseStats> phases_;
+
+ public:
+  void add(const PhaseStats& stats);
+
+  const std::vector<PhaseStats>& phases() const;
+
+  void clear();
+};
+
+// Records the statistics of the enclosing scope, or up to an explicit stop(), as
+// one phase. A null recorder makes it a no-op, so that evaluators can always open phases.
+class ScopedPhase {
+  using clock_type = std::chrono::high_resolution_clock;
+
+  PhaseRecorder* recorder_;
+  NetIOMP& network_;
+  PhaseStats stats_;
+  clock_type::time_point start_;
+
+ public:
+  ScopedPhase(PhaseRecorder* recorder, NetIOMP& network, std::string name);
+
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+  void stop();
+
+  ~ScopedPhase();
+};
+
+};  // namespace io
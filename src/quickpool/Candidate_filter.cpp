@@ -0,0 +1,168 @@
+#include "Candidate_filter.h"
+
+namespace quickpool {
+
+Candidate_filter::Candidate_filter(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, Field cell_size) :
+    id_(id),
+    rider_count_(rider_count),
+    driver_count_(driver_count),
+    network_(network),
+    cell_size_(cell_size),
+    position_(4, 0)
+    {
+        if (cell_size_ <= 0) {
+            throw std::invalid_argument("Cell size of the candidate filter must be positive.");
+        }
+    }
+
+void Candidate_filter::setInputs(Field start_x, Field start_y, Field end_x, Field end_y) {
+    position_ = {start_x, start_y, end_x, end_y};
+}
+
+// index of the grid cell containing the coordinate, rounded towards negative infinity
+int64_t Candidate_filter::cellOf(Field coord, Field cell_size) {
+    int64_t cell = coord / cell_size;
+    if (coord < 0 && coord % cell_size != 0) {
+        cell--;
+    }
+    return cell;
+}
+
+// encodes a grid cell as a PRF input, the last bit separates start cells from end cells
+emp::block Candidate_filter::cellBlock(int64_t cell_x, int64_t cell_y, bool is_end) {
+    return emp::makeBlock((uint64_t(cell_x) << 1) | uint64_t(is_end), uint64_t(cell_y));
+}
+
+// every rider and driver pair agrees on a fresh PRF key unknown to SP
+emp::block* Candidate_filter::exchangeKeys() {
+    emp::block key_own;
+    prg_.random_block(&key_own, 1);
+    emp::block* keys;
+    if (id_<=rider_count_) { // I am a rider
+        keys = new emp::block[driver_count_];
+        for (int i=rider_count_+1; i<=rider_count_+driver_count_; i++) {
+            network_->send(i, &key_own, sizeof(emp::block));
+            emp::block key_other;
+            network_->recv(i, &key_other, sizeof(emp::block));
+            keys[i-rider_count_-1] = _mm_xor_si128(key_own, key_other);
+        }
+    }
+    else { // I am a driver
+        keys = new emp::block[rider_count_];
+        for (int i=1; i<=rider_count_; i++) {
+            network_->send(i, &key_own, sizeof(emp::block));
+            emp::block key_other;
+            network_->recv(i, &key_other, sizeof(emp::block));
+            keys[i-1] = _mm_xor_si128(key_own, key_other);
+        }
+    }
+    return keys;
+}
+
+std::vector<std::vector<bool>> Candidate_filter::processCandidates() {
+    std::vector<std::vector<bool>> candidates(rider_count_, std::vector<bool>(driver_count_));
+    size_t num_pairs = rider_count_ * driver_count_;
+    std::vector<bool> packed_candidates(num_pairs);
+
+    if (id_!=0) { // I am not SP
+        auto keys = exchangeKeys();
+        int64_t start_x = cellOf(position_[0], cell_size_);
+        int64_t start_y = cellOf(position_[1], cell_size_);
+        int64_t end_x = cellOf(position_[2], cell_size_);
+        int64_t end_y = cellOf(position_[3], cell_size_);
+
+        if (id_<=rider_count_) { // I am a rider
+            // PRFs of the 3x3 neighbourhoods of the start and the end cell for each driver
+            size_t rider_len = 2 * CANDIDATE_NEIGHBOUR_CELLS;
+            emp::block cells[2 * CANDIDATE_NEIGHBOUR_CELLS];
+            for (int dx=-1, k=0; dx<=1; dx++) {
+                for (int dy=-1; dy<=1; dy++, k++) {
+                    cells[k] = cellBlock(start_x+dx, start_y+dy, false);
+                    cells[CANDIDATE_NEIGHBOUR_CELLS+k] = cellBlock(end_x+dx, end_y+dy, true);
+                }
+            }
+            emp::block* prf_result = new emp::block[driver_count_ * rider_len];
+            for (int i=0; i<driver_count_; i++) {
+                emp::block* prf_driver = prf_result + i * rider_len;
+                std::copy(cells, cells + rider_len, prf_driver);
+                emp::PRP aes(keys[i]);
+                aes.permute_block(prf_driver, rider_len);
+                // shuffle the neighbours so that SP does not learn the relative position of the cells
+                for (int half=0; half<2; half++) {
+                    emp::block* prf_half = prf_driver + half * CANDIDATE_NEIGHBOUR_CELLS;
+                    for (int k=CANDIDATE_NEIGHBOUR_CELLS-1; k>0; k--) {
+                        uint64_t r;
+                        prg_.random_data(&r, sizeof(uint64_t));
+                        std::swap(prf_half[k], prf_half[r % (k+1)]);
+                    }
+                }
+            }
+            network_->send(0, prf_result, driver_count_ * rider_len * sizeof(emp::block));
+            delete[] prf_result;
+        }
+        else { // I am a driver
+            // PRFs of the own start and end cell for each rider
+            emp::block* prf_result = new emp::block[rider_count_ * 2];
+            for (int i=0; i<rider_count_; i++) {
+                prf_result[2*i] = cellBlock(start_x, start_y, false);
+                prf_result[2*i+1] = cellBlock(end_x, end_y, true);
+                emp::PRP aes(keys[i]);
+                aes.permute_block(prf_result + 2*i, 2);
+            }
+            network_->send(0, prf_result, rider_count_ * 2 * sizeof(emp::block));
+            delete[] prf_result;
+        }
+        delete[] keys;
+
+        // receive the candidate matrix from SP
+        std::vector<uint64_t> packed((num_pairs + 63) / 64);
+        network_->recv(0, packed.data(), packed.size() * sizeof(uint64_t));
+        bool* flags = new bool[num_pairs];
+        unpackBool(packed, flags, num_pairs);
+        for (size_t i=0; i<num_pairs; i++) {
+            candidates[i / driver_count_][i % driver_count_] = flags[i];
+        }
+        delete[] flags;
+    }
+    else { // I am SP
+        size_t rider_len = 2 * CANDIDATE_NEIGHBOUR_CELLS;
+        emp::block* prf_results_riders = new emp::block[num_pairs * rider_len];
+        emp::block* prf_results_drivers = new emp::block[num_pairs * 2];
+        for (int i=1; i<=rider_count_; i++) { // receive from riders
+            network_->recv(i, prf_results_riders+(i-1)*driver_count_*rider_len, driver_count_*rider_len*sizeof(emp::block));
+        }
+        for (int i=1; i<=driver_count_; i++) { // receive from drivers
+            network_->recv(i+rider_count_, prf_results_drivers+(i-1)*rider_count_*2, rider_count_*2*sizeof(emp::block));
+        }
+
+        bool* flags = new bool[num_pairs];
+        for (int i=0; i<rider_count_; i++) {
+            for (int j=0; j<driver_count_; j++) {
+                const emp::block* r_elem = prf_results_riders + (i*driver_count_+j)*rider_len;
+                const emp::block* d_elem = prf_results_drivers + (j*rider_count_+i)*2;
+                bool start_match = false, end_match = false;
+                for (int k=0; k<CANDIDATE_NEIGHBOUR_CELLS; k++) {
+                    start_match |= emp::cmpBlock(r_elem+k, d_elem, 1);
+                    end_match |= emp::cmpBlock(r_elem+CANDIDATE_NEIGHBOUR_CELLS+k, d_elem+1, 1);
+                }
+                candidates[i][j] = start_match && end_match;
+                flags[i*driver_count_+j] = candidates[i][j];
+            }
+        }
+
+        delete[] prf_results_riders;
+        delete[] prf_results_drivers;
+
+        // broadcast the candidate matrix so that every party builds the same pruned circuit
+        auto packed = packBool(flags, num_pairs);
+        delete[] flags;
+        for (int i=1; i<=rider_count_+driver_count_; i++) {
+            network_->send(i, packed.data(), packed.size() * sizeof(uint64_t));
+        }
+        network_->flush();
+    }
+
+    return candidates;
+}
+
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "netmp.h"
+#include "helpers.h"
+
+using namespace common::utils;
+
+// number of grid cells around a rider's cell that are compared with the driver's cell (3x3 neighbourhood)
+#define CANDIDATE_NEIGHBOUR_CELLS 9
+
+namespace quickpool {
+
+// Coarse, PRF-based pre-filter that runs before the secure Euclidean distance evaluation.
+// Every rider and driver maps its start and end positions onto a square grid with cells
+// of side cell_size. Each rider-driver pair agrees on a PRF key, as in Intersection_eval;
+// riders send SP the PRFs of the 3x3 cells around their start and end cells, and drivers
+// send the PRFs of their own start and end cells. SP marks a pair as a candidate when both
+// the start and the end cell of the driver are among the neighbours of the rider's cells,
+// and broadcasts the candidate matrix so that all parties build the same pruned circuit.
+// For cell_size >= match threshold no pair within the thresholds is ever pruned.
+class Candidate_filter {
+    int id_;
+    int rider_count_;
+    int driver_count_;
+    std::shared_ptr<io::NetIOMP> network_;
+    Field cell_size_;
+    emp::PRG prg_;
+    std::vector<Field> position_;
+
+    // returns the keys shared with every party of the other side, to be freed with delete[]
+    emp::block* exchangeKeys();
+
+    static int64_t cellOf(Field coord, Field cell_size);
+
+    static emp::block cellBlock(int64_t cell_x, int64_t cell_y, bool is_end);
+
+public:
+    Candidate_filter(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, Field cell_size);
+
+    // sets the own start (x, y) and end (x, y) positions of a rider or a driver
+    void setInputs(Field start_x, Field start_y, Field end_x, Field end_y);
+
+    // returns the rider_count x driver_count candidate matrix, identical at every party
+    std::vector<std::vector<bool>> processCandidates();
+
+};
+
+};
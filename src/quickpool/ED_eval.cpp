@@ -1,7 +1,35 @@
 #include "ED_eval.h"
 
+#include <atomic>
+#include <mutex>
+
 namespace quickpool {
 
+// runs fn(start, n) over chunks of consecutive indices in [0, K) on the thread pool
+template <class F>
+static void parallelChunks(Executor& tpool, size_t K, size_t min_chunk, F fn) {
+    size_t workers = std::max(tpool.size(), 1);
+    size_t chunk = std::max<size_t>(min_chunk, (K + 4 * workers - 1) / (4 * workers));
+    std::vector<std::future<void>> res;
+    for (size_t start = 0; start < K; start += chunk) {
+        res.push_back(tpool.enqueue([&fn, start, chunk, K]() { fn(start, std::min(chunk, K - start)); }));
+    }
+    for (auto& r : res) {
+        r.get();
+    }
+}
+
+// thresholds of the buckets of a feature relative to the comparison point, which includes the
+// bound B' of the pair: bit k of a comparison is (v < B' - B*(buckets-k-1)/buckets) for the bound
+// B of the feature, the last one being (v < B'); with B' = B, bit k is (v < B*(k+1)/buckets)
+static std::vector<uint64_t> bucketThresholds(Field bound, size_t buckets) {
+    std::vector<uint64_t> t(buckets);
+    for (size_t k = 0; k < buckets; k++) {
+        t[k] = uint64_t(bound * Field(k + 1) / Field(buckets) - bound);
+    }
+    return t;
+}
+
 ED_eval::ED_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, LevelOrderedCircuit circ, int security_param, int threads, int seed)
     : id_(id),
     rider_count(rider_count),
@@ -9,8 +37,25 @@ ED_eval::ED_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::
     network_(network),
     circ_(circ),
     security_param_(security_param),
-    threads_(threads),
-    seed_(seed)
+    tpool_(std::make_shared<Executor>(threads)),
+    seed_(seed),
+    local_matching_(true),
+    buckets_(1),
+    spec_(MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD))
+    { }
+
+ED_eval::ED_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, LevelOrderedCircuit circ, int security_param, std::shared_ptr<Executor> tpool, int seed)
+    : id_(id),
+    rider_count(rider_count),
+    driver_count(driver_count),
+    network_(network),
+    circ_(circ),
+    security_param_(security_param),
+    tpool_(std::move(tpool)),
+    seed_(seed),
+    local_matching_(true),
+    buckets_(1),
+    spec_(MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD))
     { }
 
 // checking if the current party is a rider or not
@@ -23,13 +68,54 @@ bool ED_eval::amIDriver() {
   return (id_!=0 && id_>rider_count);
 }
 
+void ED_eval::setLocalMatching(bool enable) {
+  local_matching_ = enable;
+}
+
+void ED_eval::setDistanceBuckets(size_t buckets) {
+  buckets_ = std::max<size_t>(buckets, 1);
+}
+
+void ED_eval::setMatchingSpec(const MatchingSpec<Field>& spec) {
+  checkMatchingSpec(spec, pair_bounds_);
+  spec_ = spec;
+}
+
+void ED_eval::setPairBounds(std::vector<Field> bounds) {
+  checkMatchingSpec(spec_, bounds);
+  pair_bounds_ = std::move(bounds);
+}
+
+Field ED_eval::pairBound(int rider, int driver, size_t feature) const {
+  if (pair_bounds_.empty()) {
+    return spec_.features[feature].bound;
+  }
+  return pair_bounds_[(size_t(rider) * driver_count + driver) * spec_.groupSize() + feature];
+}
+
+const std::vector<int>& ED_eval::getAssignment() const {
+  return assignment_;
+}
+
+void ED_eval::setPhaseRecorder(std::shared_ptr<io::PhaseRecorder> recorder) {
+  phases_ = std::move(recorder);
+}
+
+void ED_eval::setReceivers(std::shared_ptr<ThreadPool> receivers) {
+  receivers_ = std::move(receivers);
+}
+
+std::shared_ptr<ThreadPool> ED_eval::makeReceivers(int rider_count, int driver_count) {
+  return std::make_shared<ThreadPool>(std::max<size_t>(std::min<size_t>(rider_count + driver_count, DCF_OUTPUT_RECEIVERS), 1));
+}
+
 // computing the Euclidean distances between start and end positions of a single rider and a single driver
 std::vector<Field> ED_eval::pair_matching(const std::unordered_map<wire_t, int>& input_pid_map, const std::unordered_map<wire_t, Field>& inputs, int rider_index, int driver_index) {
     std::vector<Field> res(circ_.outputs.size());  
     if (id_==0 || id_==rider_index || id_==driver_index) {
-        OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, threads_, seed_);
+        OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, tpool_, seed_);
         auto preproc = eval.run(input_pid_map);
-        OnlineEvaluator online_eval(id_, rider_count, driver_count, std::move(network_), std::move(preproc), circ_, security_param_, threads_, seed_);        
+        OnlineEvaluator online_eval(id_, rider_count, driver_count, std::move(network_), std::move(preproc), circ_, security_param_, tpool_, seed_);        
         auto res = online_eval.evaluateCircuit(inputs);
         return res;
     }
@@ -38,9 +124,9 @@ std::vector<Field> ED_eval::pair_matching(const std::unordered_map<wire_t, int>&
 
 // computing the Euclidean distances between start and end positions of multiple riders and drivers
 std::vector<Field> ED_eval::pair_matching(const std::unordered_map<wire_t, int>& input_pid_map, const std::unordered_map<wire_t, Field>& inputs) {
-    OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, threads_, seed_);
+    OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, tpool_, seed_);
     auto preproc = eval.run(input_pid_map);
-    OnlineEvaluator online_eval(id_, rider_count, driver_count, std::move(network_), std::move(preproc), circ_, security_param_, threads_, seed_);
+    OnlineEvaluator online_eval(id_, rider_count, driver_count, std::move(network_), std::move(preproc), circ_, security_param_, tpool_, seed_);
     auto res = online_eval.evaluateCircuit(inputs);
     return res;
 }
@@ -51,7 +137,7 @@ std::vector<Field> ED_eval::pair_EDMatching(const std::unordered_map<wire_t, int
     
     if (id_==0 || id_==rider_index || id_==driver_index) {
         // preprocessing phase for computing the Euclidean distances
-        OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, threads_, seed_);
+        OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, tpool_, seed_);
         auto preproc = eval.run(input_pid_map);
 
         Field mask0, mask1;
@@ -61,7 +147,7 @@ std::vector<Field> ED_eval::pair_EDMatching(const std::unordered_map<wire_t, int
         }        
         
         //online phase for computing the Euclidean distances
-        OnlineEvaluator online_eval(id_, rider_count, driver_count, network_, std::move(preproc), circ_, security_param_, threads_, seed_);
+        OnlineEvaluator online_eval(id_, rider_count, driver_count, network_, std::move(preproc), circ_, security_param_, tpool_, seed_);
         online_eval.setInputs(inputs);
         for (size_t i = 0; i < circ_.gates_by_level.size(); ++i) {
             online_eval.evaluateGatesAtDepth(i);
@@ -69,54 +155,29 @@ std::vector<Field> ED_eval::pair_EDMatching(const std::unordered_map<wire_t, int
 
         // DCF to compare if the distances are within the given thresholds
         if (id_==0) {
-            uint8_t k_rider0[KEY_LEN], k_rider1[KEY_LEN], k_driver0[KEY_LEN], k_driver1[KEY_LEN];
-            std::vector<uint8_t> k_rider(2 * KEY_LEN);
-            std::vector<uint8_t> k_driver(2 * KEY_LEN);
+            std::vector<uint8_t> k_rider(2 * EDComparison::KEY_LEN_);
+            std::vector<uint8_t> k_driver(2 * EDComparison::KEY_LEN_);
+            // the bounds are folded into the comparison points
+            int rider = rider_index - 1, driver = driver_index - rider_count - 1;
+            uint64_t alpha[2] = {uint64_t(mask0 + pairBound(rider, driver, 0)), uint64_t(mask1 + pairBound(rider, driver, 1))};
+            uint8_t* k0[2] = {&k_rider[0], &k_rider[EDComparison::KEY_LEN_]};
+            uint8_t* k1[2] = {&k_driver[0], &k_driver[EDComparison::KEY_LEN_]};
             // SP generates the keys for DCF and sends to the rider and driver
-            DCF_gen(mask0, k_rider0, k_driver0);
-            DCF_gen(mask1, k_rider1, k_driver1);        
-            for(int i = 0; i < 2 * KEY_LEN; i++) {
-                if(i < KEY_LEN) {
-                    k_rider[i] = k_rider0[i];
-                    k_driver[i] = k_driver0[i];
-                }
-                else {
-                    k_rider[i] = k_rider1[i-KEY_LEN];
-                    k_driver[i] = k_driver1[i - KEY_LEN];
-                }
-            }            
+            EDComparison::gen_batch(2, alpha, k0, k1);
             network_->send(rider_index, k_rider.data(), k_rider.size() * sizeof(uint8_t));
             network_->send(driver_index, k_driver.data(), k_driver.size() * sizeof(uint8_t));
         }
 
         if (id_!=0){
-            Field masked_val0, masked_val1;
-            masked_val0 = online_eval.getwires()[circ_.outputs[0]]; // masked_val should be updated for comparison
-            masked_val0 = masked_val0 - (START_MATCH_THRESHOLD * START_MATCH_THRESHOLD);
-            masked_val1 = online_eval.getwires()[circ_.outputs[1]];
-            masked_val1 = masked_val1 - (END_MATCH_THRESHOLD * END_MATCH_THRESHOLD);
-
-            uint8_t key0[KEY_LEN], key1[KEY_LEN];
-            std::vector<uint8_t> key(2 * KEY_LEN, 0);
-            network_->recv(0, key.data(), key.size() * sizeof(uint8_t)); // key size may differ.
-            for(int i = 0;  i < 2 * KEY_LEN; ++i) {
-                if(i < KEY_LEN) {
-                    key0[i] = key[i];
-                }
-                else {
-                    key1[i - KEY_LEN] = key[i];
-                }
-            }
+            Field masked_val0 = online_eval.wires()[circ_.outputs[0]];
+            Field masked_val1 = online_eval.wires()[circ_.outputs[1]];
 
-            Field comp_output0, comp_output1;
-            if (id_==rider_index) {
-                comp_output0 = DCF_eval(0, key0, masked_val0);
-                comp_output1 = DCF_eval(0, key1, masked_val1);
-            }
-            else if (id_==driver_index) {
-                comp_output0 = DCF_eval(1, key0, masked_val0);
-                comp_output1 = DCF_eval(1, key1, masked_val1);
-            }            
+            std::vector<uint8_t> key(2 * EDComparison::KEY_LEN_, 0);
+            network_->recv(0, key.data(), key.size() * sizeof(uint8_t));
+
+            bool b = (id_==driver_index);
+            Field comp_output0 = EDComparison::eval(b, &key[0], uint64_t(masked_val0));
+            Field comp_output1 = EDComparison::eval(b, &key[EDComparison::KEY_LEN_], uint64_t(masked_val1));
 
             output.push_back(comp_output0);
             output.push_back(comp_output1);
@@ -129,162 +190,612 @@ std::vector<Field> ED_eval::pair_EDMatching(const std::unordered_map<wire_t, int
 std::vector<Field> ED_eval::pair_EDMatching(const std::unordered_map<wire_t, int>& input_pid_map, const std::unordered_map<wire_t, Field>& inputs) { 
     std::vector<Field> output;
     
-    // preprocessing phase for computing the Euclidean distances
-    OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, threads_, seed_);
-    auto preproc = eval.run(input_pid_map);
-
-    std::vector<Field> masks;
-    if (id_==0) {
-        for (size_t i = 0; i < circ_.outputs.size(); ++i) {
-            auto wout = circ_.outputs[i];
-            masks.push_back(preproc.gates[wout]->tpmask.secret());
-        }     
-    }        
+    // preprocessing phase for computing the Euclidean distances, including the DCF keys
+    io::ScopedPhase offline_phase(phases_.get(), *network_, "offline");
+    OfflineEvaluator eval(id_, rider_count, driver_count, network_, circ_, security_param_, tpool_, seed_);
+    eval.setWireMasks(input_pid_map);
+    offline_phase.stop();
+    {
+        io::ScopedPhase key_phase(phases_.get(), *network_, "dcf_keys");
+        // SP folds the bound of the feature of every output into its comparison point
+        std::vector<Field> bounds;
+        if (id_==0) {
+            bounds.reserve(circ_.outputs.size());
+            for (size_t i = 0; i < circ_.outputs.size(); i++) {
+                const auto& owners = circ_.output_owners.at(circ_.outputs[i]);
+                bounds.push_back(pairBound(owners[0] - 1, owners[1] - rider_count - 1, i % spec_.groupSize()));
+            }
+        }
+        eval.setDCFKeys(bounds);
+    }
+    auto preproc = eval.getPreproc();
+    std::vector<uint8_t> keys = std::move(preproc.dcf_keys);
     
     // online phase for computing the Euclidean distances
-    OnlineEvaluator online_eval(id_, rider_count, driver_count, network_, std::move(preproc), circ_, security_param_, threads_, seed_);
-    online_eval.setInputs(inputs);
+    OnlineEvaluator online_eval(id_, rider_count, driver_count, network_, std::move(preproc), circ_, security_param_, tpool_, seed_);
+    {
+        io::ScopedPhase input_phase(phases_.get(), *network_, "input");
+        online_eval.setInputs(inputs);
+    }
     for (size_t i = 0; i < circ_.gates_by_level.size(); ++i) {
+        io::ScopedPhase depth_phase(phases_.get(), *network_, "online_depth_" + std::to_string(i));
         online_eval.evaluateGatesAtDepth(i);
     }
 
-    // DCF to compare if the distances are within the given thresholds
-    std::vector<Field> lengths(rider_count+driver_count,0);
-    if (id_==0) {
-        uint8_t k_rider[KEY_LEN], k_driver[KEY_LEN];
-        std::vector<std::vector<uint8_t>> keys_for_parties(rider_count+driver_count);
-        for (size_t i = 0; i < circ_.outputs.size(); i++) {
-            auto wout = circ_.outputs[i];
-            int rider_id = circ_.output_owners[wout][0];
-            int driver_id = circ_.output_owners[wout][1];
-            Field mask = masks[i];
-            // SP generates the keys for DCF and sends to riders and drivers
-            DCF_gen(mask, k_rider, k_driver);            
-            for (size_t j=0; j<KEY_LEN; j++) {
-                keys_for_parties[rider_id-1].push_back(k_rider[j]);
-                keys_for_parties[driver_id-1].push_back(k_driver[j]);
+    // DCF to compare if the features are within their bounds
+    size_t group = spec_.groupSize();
+    std::vector<size_t> lengths(rider_count+driver_count,0);
+    for (auto wout : circ_.outputs) {
+        lengths[circ_.output_owners[wout][0]-1]++;
+        lengths[circ_.output_owners[wout][1]-1]++;
+    }
+
+    if (id_!=0){
+        io::ScopedPhase eval_phase(phases_.get(), *network_, "dcf_eval");
+        // the masked outputs of the pairs of this party go straight into one compact array of DCF
+        // inputs, the bounds being folded into the keys; the outputs of a pair are adjacent
+        const auto& wires = online_eval.wires();
+        std::vector<uint64_t> x_hat;
+        x_hat.reserve(lengths[id_-1]);
+        for (size_t i = 0; i < circ_.outputs.size(); i += group) {
+            const auto& owners = circ_.output_owners.at(circ_.outputs[i]);
+            if (id_==owners[0] || id_==owners[1]) {
+                for (size_t f = 0; f < group; f++) {
+                    x_hat.push_back(uint64_t(wires[circ_.outputs[i+f]]));
+                }
+            }
+        }
+
+        std::vector<uint8_t> comp_output(x_hat.size() * buckets_);
+        if (buckets_ == 1) {
+            // all comparisons of this party are evaluated together, interleaving the keys
+            EDBitComparison::eval_batch(x_hat.size(), amIDriver(), keys.data(), x_hat.data(), comp_output.data());
+        }
+        else {
+            // every key is evaluated at all the bucket thresholds of its comparison
+            std::vector<std::vector<uint64_t>> thresholds;
+            for (const auto& f : spec_.features) {
+                thresholds.push_back(bucketThresholds(f.bound, buckets_));
+            }
+            std::vector<const uint64_t*> key_thresholds(x_hat.size());
+            for (size_t k = 0; k < x_hat.size(); k++) {
+                key_thresholds[k] = thresholds[k % group].data();
             }
-            lengths[rider_id-1]++;
-            lengths[driver_id-1]++;
+            parallelChunks(*tpool_, x_hat.size(), AES_LANES, [&](size_t start, size_t n) {
+                EDBitComparison::eval_thresholds_batch(n, amIDriver(), &keys[start * EDBitComparison::KEY_LEN_], &x_hat[start],
+                                                       buckets_, &key_thresholds[start], &comp_output[start * buckets_]);
+            });
         }
-        for (size_t i = 1; i <= rider_count+driver_count; i++) {
-            network_->send(i, keys_for_parties[i-1].data(), keys_for_parties[i-1].size() * sizeof(uint8_t));
+        // riders and drivers send the XOR shares of DCF output to SP for reconstruction,
+        // one bit per comparison and bucket threshold
+        std::vector<uint64_t> output_share((comp_output.size() + 63) / 64, 0);
+        for (size_t k = 0; k < comp_output.size(); k++) {
+            output_share[k / 64] |= uint64_t(comp_output[k] & 1) << (k % 64);
         }
+        network_->send(0, output_share.data(), output_share.size() * sizeof(uint64_t));
+        network_->flush(0);
     }
 
-    if (id_!=0){
-        std::vector<Field> masked_vals;
-        for (size_t i = 0; i < circ_.outputs.size();) {
-            auto wires = online_eval.getwires();
-            auto wout = circ_.outputs[i++];            
-            int rider_id = circ_.output_owners[wout][0];
-            int driver_id = circ_.output_owners[wout][1];
-            if (id_==rider_id || id_==driver_id) {
-                masked_vals.push_back(wires[wout]-(START_MATCH_THRESHOLD * START_MATCH_THRESHOLD));
-                auto wout = circ_.outputs[i++];
-                masked_vals.push_back(wires[wout]-(END_MATCH_THRESHOLD * END_MATCH_THRESHOLD));
-            }            
-        }
-        std::vector<uint8_t> keys(masked_vals.size() * KEY_LEN);
-        network_->recv(0, keys.data(), masked_vals.size() * KEY_LEN * sizeof(uint8_t));
-        std::vector<Field> output_share;
-        if (amIRider()) {
-            for (size_t i = 0; i < masked_vals.size(); i++) {
-                Field mask_val = masked_vals[i];
-                uint8_t k[KEY_LEN];
-                std::copy(keys.begin()+(i*KEY_LEN), keys.begin()+(i*KEY_LEN)+KEY_LEN, k);
-                Field out_share = DCF_eval(0, k, mask_val);
-                output_share.push_back(out_share);
-                mask_val = masked_vals[++i];
-                std::copy(keys.begin()+(i*KEY_LEN), keys.begin()+(i*KEY_LEN)+KEY_LEN, k);
-                out_share = DCF_eval(0, k, mask_val);
-                output_share.push_back(out_share);
+    if (id_==0) {
+        io::ScopedPhase output_phase(phases_.get(), *network_, "dcf_output");
+        size_t num_outputs = circ_.outputs.size();
+        size_t num_pairs = num_outputs / group;
+        // the outputs of every party, in the order of its shares
+        std::vector<std::vector<size_t>> party_outputs(rider_count+driver_count);
+        for (size_t i = 0; i < num_outputs; i++) {
+            const auto& owners = circ_.output_owners.at(circ_.outputs[i]);
+            party_outputs[owners[0]-1].push_back(i);
+            party_outputs[owners[1]-1].push_back(i);
+        }
+
+        // reconstructed concurrently by the receivers of the rider and of the driver of a pair
+        std::vector<std::atomic<uint64_t>> comp((num_outputs * buckets_ + 63) / 64);
+        std::vector<std::atomic<uint8_t>> pending(num_pairs);
+        for (auto& p : pending) {
+            p = 2;
+        }
+        output.assign(num_pairs, Field(0));
+        BitMatrix match(local_matching_ && buckets_ == 1 ? rider_count : 0, driver_count);
+        // greedy matching grown while the matches arrive, the warm start of Hopcroft-Karp
+        std::vector<int> greedy(match.rows(), -1);
+        std::vector<bool> driver_taken(match.rows() ? driver_count : 0, false);
+        std::vector<CostEdge> edges;
+        std::mutex matching_lock;
+
+        // the bucket of a comparison is the number of bucket thresholds its distance is not
+        // below, a distance out of range is in bucket buckets_
+        auto bucket = [&](size_t i) {
+            size_t below = 0;
+            for (size_t k = i * buckets_; k < (i + 1) * buckets_; k++) {
+                below += (comp[k / 64] >> (k % 64)) & 1;
+            }
+            return buckets_ - below;
+        };
+        // the comparisons of the features of a pair are adjacent, it is a match when all of
+        // them are in range and its cost is the sum of their buckets
+        auto settle = [&](size_t pair) {
+            bool is_match = true;
+            size_t cost = 0;
+            for (size_t f = 0; f < group; f++) {
+                size_t b = bucket(pair * group + f);
+                is_match = is_match && b < buckets_;
+                cost += b;
+            }
+            output[pair] = Field(is_match);
+            if (local_matching_ && is_match) {
+                std::lock_guard<std::mutex> guard(matching_lock);
+                const auto& owners = circ_.output_owners.at(circ_.outputs[pair * group]);
+                int rider = owners[0] - 1;
+                int driver = owners[1] - rider_count - 1;
+                if (buckets_ == 1) {
+                    match.set(rider, driver);
+                    if (greedy[rider] < 0 && !driver_taken[driver]) {
+                        greedy[rider] = driver;
+                        driver_taken[driver] = true;
+                    }
+                }
+                else {
+                    edges.push_back({rider, driver, int64_t(cost)});
+                }
+            }
+        };
+
+        // every party's shares are received on its own task and XORed into the reconstructed
+        // DCF outputs as soon as they arrive; a pair is settled by the last of its rider and its
+        // driver, so a straggler only delays its own pairs. Only the matching is serialised
+        network_->flush(rider_count, driver_count);
+        if (!receivers_) {
+            receivers_ = makeReceivers(rider_count, driver_count);
+        }
+        std::vector<std::future<void>> res;
+        for (int p = 1; p <= rider_count + driver_count; p++) {
+            if (party_outputs[p-1].empty()) {
+                continue;
+            }
+            res.push_back(receivers_->enqueue([&, p]() {
+                const auto& outs = party_outputs[p-1];
+                std::vector<uint64_t> share((outs.size() * buckets_ + 63) / 64);
+                network_->recv(p, share.data(), share.size() * sizeof(uint64_t));
+                for (size_t j = 0; j < outs.size(); j++) {
+                    for (size_t b = 0; b < buckets_; b++) {
+                        size_t k = j * buckets_ + b, dst = outs[j] * buckets_ + b;
+                        if ((share[k / 64] >> (k % 64)) & 1) {
+                            comp[dst / 64].fetch_xor(uint64_t(1) << (dst % 64));
+                        }
+                    }
+                    if (outs[j] % group == group - 1 && pending[outs[j] / group].fetch_sub(1) == 1) {
+                        settle(outs[j] / group);
+                    }
+                }
+            }));
+        }
+        for (auto& r : res) {
+            r.get();
+        }
+        output_phase.stop();
+
+        // SP completes the greedy matching to a maximal one, or finds the one of the closest
+        // pairs when the distance buckets are known
+        if (local_matching_) {
+            io::ScopedPhase matching_phase(phases_.get(), *network_, "matching");
+            if (buckets_ == 1) {
+                assignment_ = hopcroftKarp(match, greedy, tpool_.get());
+            }
+            else {
+                // in the order of the pairs, whatever the order of arrival
+                std::sort(edges.begin(), edges.end(), [](const CostEdge& a, const CostEdge& b) {
+                    return std::make_pair(a.rider, a.driver) < std::make_pair(b.rider, b.driver);
+                });
+                assignment_ = minCostAssignment(rider_count, driver_count, edges, tpool_.get());
             }
         }
-        else if (amIDriver()) {
-            for (size_t i = 0; i < masked_vals.size(); i++) {
-                Field mask_val = masked_vals[i];
-                uint8_t k[KEY_LEN];
-                std::copy(keys.begin()+(i*KEY_LEN), keys.begin()+(i*KEY_LEN)+KEY_LEN, k);
-                Field out_share = DCF_eval(1, k, mask_val);
-                output_share.push_back(out_share);
-                mask_val = masked_vals[++i];
-                std::copy(keys.begin()+(i*KEY_LEN), keys.begin()+(i*KEY_LEN)+KEY_LEN, k);
-                out_share = DCF_eval(1, k, mask_val);
-                output_share.push_back(out_share);
+    }
+
+    return output;
+
+}
+
+// matching among all riders and drivers, one tile of pairs at a time; a tile only involves SP
+// and its riders and drivers, and its circuit and inputs only depend on the size of the tile
+std::vector<Field> ED_eval::pair_EDMatchingTiled(const std::vector<Field>& position, size_t tile_riders, size_t tile_drivers) {
+    tile_riders = std::max<size_t>(tile_riders, 1);
+    tile_drivers = std::max<size_t>(tile_drivers, 1);
+    if (id_ != 0) {
+        checkCoordinates(spec_, position);
+    }
+    else if (!receivers_) {
+        // the same receivers for all tiles
+        receivers_ = makeReceivers(rider_count, driver_count);
+    }
+    std::vector<Field> output(id_==0 ? rider_count * driver_count : 0);
+    BitMatrix match(id_==0 && local_matching_ ? rider_count : 0, driver_count);
+
+    std::vector<int> riders, drivers;
+    std::unordered_map<wire_t, int> input_pid_map;
+    std::unordered_map<wire_t, Field> inputs;
+
+    for (size_t r0 = 0; r0 < rider_count; r0 += tile_riders) {
+        size_t r1 = std::min<size_t>(r0 + tile_riders, rider_count);
+        riders.clear();
+        for (size_t r = r0; r < r1; r++) {
+            riders.push_back(r);
+        }
+        for (size_t d0 = 0; d0 < driver_count; d0 += tile_drivers) {
+            size_t d1 = std::min<size_t>(d0 + tile_drivers, driver_count);
+            if (amIRider() && (size_t(id_-1) < r0 || size_t(id_-1) >= r1)) {
+                break;
+            }
+            if (amIDriver() && (size_t(id_-rider_count-1) < d0 || size_t(id_-rider_count-1) >= d1)) {
+                continue;
+            }
+            drivers.clear();
+            for (size_t d = d0; d < d1; d++) {
+                drivers.push_back(d);
+            }
+
+            auto circ = Circuit<Field>::generateBlockCircuit(rider_count, riders, drivers, spec_);
+            input_pid_map.clear();
+            inputs.clear();
+            setBlockInputs(id_, rider_count, riders, drivers, position, input_pid_map, inputs);
+
+            ED_eval tile_eval(id_, rider_count, driver_count, network_, circ.orderGatesByLevel(), security_param_, tpool_, seed_);
+            tile_eval.setLocalMatching(false);
+            tile_eval.setMatchingSpec(spec_);
+            tile_eval.setPairBounds(pair_bounds_);
+            tile_eval.setPhaseRecorder(phases_);
+            tile_eval.setReceivers(receivers_);
+            auto tile_output = tile_eval.pair_EDMatching(input_pid_map, inputs);
+
+            // SP places the outputs of the tile at their row-major positions
+            if (id_==0) {
+                for (size_t r = r0, k = 0; r < r1; r++) {
+                    for (size_t d = d0; d < d1; d++, k++) {
+                        output[r * driver_count + d] = tile_output[k];
+                        if (local_matching_) {
+                            match.set(r, d, bool(tile_output[k]));
+                        }
+                    }
+                }
             }
         }
-        // riders and drivers send the shares of DCF output to SP for reconstruction
-        network_->send(0, output_share.data(), output_share.size() * sizeof(Field));
     }
 
+    // SP locally runs the algorithm for finding the maximal matching
+    if (id_==0 && local_matching_) {
+        io::ScopedPhase matching_phase(phases_.get(), *network_, "matching");
+        assignment_ = hopcroftKarp(match, tpool_.get());
+    }
+    return output;
+}
+
+// matching among all riders and drivers with the funshade scalar product and sign gate
+std::vector<Field> ED_eval::pair_EDMatchingFunshade(const std::vector<Field>& position) {
+    const size_t l = FUNSHADE_ED_LEN;
+    auto& tpool = *tpool_;
+    std::vector<Field> output;
+    checkFunshadeInputs(id_==0 ? std::vector<Field>(4, 0) : position, pair_bounds_);
+
+    // the start and end comparison of every pair, in rider-major order: (rider, driver, start/end)
+    auto comparisons = [&](int pid) {
+        std::vector<size_t> idx;
+        for (int rider=0; rider<rider_count; rider++) {
+            for (int driver=0; driver<driver_count; driver++) {
+                if (pid==rider+1 || pid==driver+rider_count+1) {
+                    idx.push_back(2*(rider*driver_count+driver));
+                    idx.push_back(2*(rider*driver_count+driver)+1);
+                }
+            }
+        }
+        return idx;
+    };
+
     if (id_==0) {
-        std::vector<std::vector<bool>> match(rider_count, std::vector<bool>(driver_count));
-        std::vector<std::vector<Field>> output_shares(rider_count+driver_count);
-        // network_->flush();
-        network_->flush(rider_count, driver_count);
-        for (size_t i = 1; i <= rider_count+driver_count; i++) {
-            output_shares[i-1].resize(lengths[i-1]);
-            network_->recv(i, output_shares[i-1].data(), lengths[i-1]*sizeof(Field));
-        }
-        std::vector<size_t> index(rider_count+driver_count, 0);
-        for (size_t i = 0; i < circ_.outputs.size(); i++) {
-            auto wout = circ_.outputs[i];
-            int rider_id = circ_.output_owners[wout][0];
-            int driver_id = circ_.output_owners[wout][1];
-            // SP recontructs the DCF output
-            Field start_comp_output = output_shares[rider_id-1][index[rider_id-1]] + output_shares[driver_id-1][index[driver_id-1]];
-            index[rider_id-1]++;
-            index[driver_id-1]++;
-            i++;
-            // SP recontructs the DCF output
-            Field end_comp_output = output_shares[rider_id-1][index[rider_id-1]] + output_shares[driver_id-1][index[driver_id-1]];
-            index[rider_id-1]++;
-            index[driver_id-1]++;
-            output.push_back(start_comp_output*end_comp_output);
-            match[rider_id-1][driver_id-rider_count-1] = bool(start_comp_output*end_comp_output);
+        size_t K = 2 * rider_count * driver_count;
+        std::vector<R_t> d_x0(K*l), d_x1(K*l), d_y0(K*l), d_y1(K*l), d_xy0(K*l), d_xy1(K*l), r_in_0(K), r_in_1(K);
+        std::vector<uint8_t> k0(K*KEY_LEN), k1(K*KEY_LEN);
+        {
+            io::ScopedPhase setup_phase(phases_.get(), *network_, "funshade_setup");
+            parallelChunks(tpool, K, AES_LANES, [&](size_t start, size_t n) {
+                funshade_setup_batch(n, l, 0, &d_x0[start*l], &d_x1[start*l], &d_y0[start*l], &d_y1[start*l],
+                                     &d_xy0[start*l], &d_xy1[start*l], &r_in_0[start], &r_in_1[start],
+                                     &k0[start*KEY_LEN], &k1[start*KEY_LEN]);
+            });
+            // the sign gate gives (z-theta >= 0), i.e. whether the distance is out of range
+            for (size_t c = 0; c < K; c++) {
+                Field bound = c % 2 == 0 ? START_MATCH_THRESHOLD * START_MATCH_THRESHOLD
+                                         : END_MATCH_THRESHOLD * END_MATCH_THRESHOLD;
+                r_in_1[c] -= R_t(pair_bounds_.empty() ? bound : pair_bounds_[c]);
+            }
+
+            // riders get the masks of x and party 0's material, drivers those of y and party 1's
+            for (int pid = 1; pid <= rider_count + driver_count; pid++) {
+                bool j = pid > rider_count;
+                auto own = comparisons(pid);
+                size_t n = own.size();
+                std::vector<R_t> d_v(n*l), d_j(3*n*l), r_j(n);
+                std::vector<uint8_t> keys(n*KEY_LEN);
+                for (size_t c = 0; c < n; c++) {
+                    for (size_t i = 0; i < l; i++) {
+                        size_t idx = own[c]*l + i;
+                        d_v[c*l+i] = j ? d_y0[idx] + d_y1[idx] : d_x0[idx] + d_x1[idx];
+                        d_j[c*l+i] = j ? d_x1[idx] : d_x0[idx];
+                        d_j[(n+c)*l+i] = j ? d_y1[idx] : d_y0[idx];
+                        d_j[(2*n+c)*l+i] = j ? d_xy1[idx] : d_xy0[idx];
+                    }
+                    r_j[c] = j ? r_in_1[own[c]] : r_in_0[own[c]];
+                    memcpy(&keys[c*KEY_LEN], j ? &k1[own[c]*KEY_LEN] : &k0[own[c]*KEY_LEN], KEY_LEN);
+                }
+                network_->send(pid, d_v.data(), d_v.size() * sizeof(R_t));
+                network_->send(pid, d_j.data(), d_j.size() * sizeof(R_t));
+                network_->send(pid, r_j.data(), r_j.size() * sizeof(R_t));
+                network_->send(pid, keys.data(), keys.size() * sizeof(uint8_t));
+                network_->flush(pid);
+            }
         }
+
+        io::ScopedPhase output_phase(phases_.get(), *network_, "funshade_output");
+        // SP gathers the XOR shares of the riders and of the drivers in comparison order
+        std::vector<uint64_t> rider_bits((K + 63) / 64, 0), driver_bits((K + 63) / 64, 0);
+        for (int pid = 1; pid <= rider_count + driver_count; pid++) {
+            auto own = comparisons(pid);
+            std::vector<uint64_t> packed((own.size() + 63) / 64);
+            network_->recv(pid, packed.data(), packed.size() * sizeof(uint64_t));
+            auto& bits = pid > rider_count ? driver_bits : rider_bits;
+            for (size_t c = 0; c < own.size(); c++) {
+                bits[own[c] / 64] |= ((packed[c / 64] >> (c % 64)) & 1) << (own[c] % 64);
+            }
+        }
+        // a pair matches when neither its start nor its end distance is out of range
+        BitMatrix match(local_matching_ ? rider_count : 0, driver_count);
+        for (size_t c = 0; c < K; c += 2) {
+            uint64_t far = rider_bits[c / 64] ^ driver_bits[c / 64];
+            bool is_match = !((far >> (c % 64)) & 3);
+            output.push_back(Field(is_match));
+            if (local_matching_) {
+                match.set(c / 2 / driver_count, c / 2 % driver_count, is_match);
+            }
+        }
+        output_phase.stop();
+
         // SP locally runs the algorithm for finding the maximal matching
-        int maxBPM_res = maxBPM(match); // just for benchmarking
+        if (local_matching_) {
+            io::ScopedPhase matching_phase(phases_.get(), *network_, "matching");
+            assignment_ = hopcroftKarp(match, tpool_.get());
+        }
+        return output;
+    }
+
+    // rider (party 0 of funshade) or driver (party 1)
+    bool j = amIDriver();
+    auto own = comparisons(id_);
+    size_t n = own.size();
+    std::vector<int> counterparts;
+    for (int pid = j ? 1 : rider_count + 1; pid <= (j ? rider_count : rider_count + driver_count); pid++) {
+        counterparts.push_back(pid);
+    }
+    std::vector<R_t> d_v(n*l), d_j(3*n*l), r_j(n);
+    std::vector<uint8_t> keys(n*KEY_LEN);
+    {
+        io::ScopedPhase setup_phase(phases_.get(), *network_, "funshade_setup");
+        network_->recv(0, d_v.data(), d_v.size() * sizeof(R_t));
+        network_->recv(0, d_j.data(), d_j.size() * sizeof(R_t));
+        network_->recv(0, r_j.data(), r_j.size() * sizeof(R_t));
+        network_->recv(0, keys.data(), keys.size() * sizeof(uint8_t));
+    }
+
+    // own vectors, masked and exchanged with every counterpart; the comparisons with a
+    // counterpart are the 2 consecutive ones of the pair
+    std::vector<R_t> D_own(n*l), D_other(n*l);
+    {
+        io::ScopedPhase share_phase(phases_.get(), *network_, "funshade_share");
+        std::vector<R_t> v(n*l);
+        for (size_t c = 0; c < n; c++) {
+            R_t x = R_t(position[2*(c%2)]), y = R_t(position[2*(c%2)+1]);
+            R_t* vec = &v[c*l];
+            if (j) {
+                vec[0] = -2*x;  vec[1] = -2*y;  vec[2] = 1;  vec[3] = x*x + y*y;
+            }
+            else {
+                vec[0] = x;  vec[1] = y;  vec[2] = x*x + y*y;  vec[3] = 1;
+            }
+        }
+        funshade_share_batch(n, l, v.data(), d_v.data(), D_own.data());
+        for (size_t t = 0; t < counterparts.size(); t++) {
+            network_->send(counterparts[t], &D_own[t*2*l], 2*l*sizeof(R_t));
+        }
+        network_->flush(rider_count, driver_count);
+        for (size_t t = 0; t < counterparts.size(); t++) {
+            network_->recv(counterparts[t], &D_other[t*2*l], 2*l*sizeof(R_t));
+        }
     }
 
+    // shares of the masked squared distances, exchanged with the counterparts
+    std::vector<R_t> z_own(n), z_other(n);
+    {
+        io::ScopedPhase dist_phase(phases_.get(), *network_, "funshade_dist");
+        const R_t* D_x = j ? D_other.data() : D_own.data();
+        const R_t* D_y = j ? D_own.data() : D_other.data();
+        parallelChunks(tpool, n, DIST_BLOCK / l, [&](size_t start, size_t len) {
+            funshade_eval_dist_batch(len, l, j, &r_j[start], &D_x[start*l], &D_y[start*l], &d_j[start*l],
+                                     &d_j[(n+start)*l], &d_j[(2*n+start)*l], &z_own[start]);
+        });
+        for (size_t t = 0; t < counterparts.size(); t++) {
+            network_->send(counterparts[t], &z_own[t*2], 2*sizeof(R_t));
+        }
+        network_->flush(rider_count, driver_count);
+        for (size_t t = 0; t < counterparts.size(); t++) {
+            network_->recv(counterparts[t], &z_other[t*2], 2*sizeof(R_t));
+        }
+    }
+
+    // XOR shares of the sign, one bit per comparison to SP
+    io::ScopedPhase sign_phase(phases_.get(), *network_, "funshade_sign");
+    std::vector<R_t> o(n);
+    const R_t* z_hat_0 = j ? z_other.data() : z_own.data();
+    const R_t* z_hat_1 = j ? z_own.data() : z_other.data();
+    parallelChunks(tpool, n, AES_LANES, [&](size_t start, size_t len) {
+        funshade_eval_sign_batch(len, j, &keys[start*KEY_LEN], &z_hat_0[start], &z_hat_1[start], &o[start]);
+    });
+    std::vector<uint64_t> packed((n + 63) / 64, 0);
+    for (size_t c = 0; c < n; c++) {
+        packed[c / 64] |= uint64_t(o[c] & 1) << (c % 64);
+    }
+    network_->send(0, packed.data(), packed.size() * sizeof(uint64_t));
+    network_->flush(0);
     return output;
+}
+
+size_t ED_eval::tileFixedBytes(int rider_count, int driver_count) {
+    size_t pairs = size_t(rider_count) * driver_count;
+    return pairs * sizeof(Field) + pairs / 8 + size_t(rider_count + driver_count) * TILE_BYTES_PER_PARTY;
+}
+
+size_t ED_eval::tileSide(size_t memory_budget, int rider_count, int driver_count) {
+    size_t fixed = tileFixedBytes(rider_count, driver_count);
+    if (memory_budget <= fixed) {
+        return 1;
+    }
+    size_t side = std::sqrt(double((memory_budget - fixed) / TILE_BYTES_PER_PAIR));
+    return std::max<size_t>(side, 1);
+}
 
+void setEDSInputs(int rider_count, int driver_count, const std::vector<std::vector<bool>>& pairs,
+                  const std::vector<Field>& position, std::unordered_map<wire_t, int>& input_pid_map,
+                  std::unordered_map<wire_t, Field>& inputs) {
+    for (int rider=0, j=0; rider<rider_count; rider++) {
+        int rider_id = rider+1;
+        for (int driver=0; driver<driver_count; driver++) {
+            if (!pairs[rider][driver]) {
+                continue;
+            }
+            int driver_id = driver+rider_count+1;
+            for (int i=0; i<2; ++i) {
+                input_pid_map[j] = rider_id;
+                inputs[j++] = position[i];
+                input_pid_map[j] = rider_id;
+                inputs[j++] = position[2+i];
+                input_pid_map[j] = driver_id;
+                inputs[j++] = position[i];
+                input_pid_map[j] = driver_id;
+                inputs[j++] = position[2+i];
+            }
+            j+= 6; // to skip subtraction gates and dotproduct gates in the circuit
+        }
+    }
 }
 
+void setEDSSharedInputs(int rider_count, int driver_count, const std::vector<Field>& position,
+                        std::unordered_map<wire_t, int>& input_pid_map, std::unordered_map<wire_t, Field>& inputs) {
+    for (int party=0, j=0; party<rider_count+driver_count; party++) {
+        for (size_t i=0; i<position.size(); ++i) {
+            input_pid_map[j] = party+1;
+            inputs[j++] = position[i];
+        }
+    }
+}
 
-bool bpm(std::vector<std::vector<bool>> bpGraph, int u,
-        std::vector<bool> seen, std::vector<int> matchR)
-{
-    int M = bpGraph.size();
-    int N = bpGraph[0].size();
-    for (int v = 0; v < N; v++) {
-        if (bpGraph[u][v] && !seen[v]) {
-            seen[v] = true; 
-            if (matchR[v] < 0 || bpm(bpGraph, matchR[v],
-                                    seen, matchR)) {
-                matchR[v] = u;
-                return true;
+void setBlockInputs(int id, int rider_count, const std::vector<int>& riders, const std::vector<int>& drivers,
+                    const std::vector<Field>& position, std::unordered_map<wire_t, int>& input_pid_map,
+                    std::unordered_map<wire_t, Field>& inputs) {
+    size_t j = 0;
+    for (size_t i=0; i<riders.size()+drivers.size(); i++) {
+        int party_id = i < riders.size() ? riders[i]+1 : drivers[i-riders.size()]+rider_count+1;
+        for (size_t k=0; k<position.size(); k++, j++) {
+            input_pid_map[j] = party_id;
+            if (party_id == id) {
+                inputs[j] = position[k];
             }
         }
     }
-    return false;
 }
 
-// Gale-Shapley algorithm for finding maximal matching in a bipartite graph
-int maxBPM(std::vector<std::vector<bool>> bpGraph) {
-    int M = bpGraph.size();
-    int N = bpGraph[0].size();
+// whether every value of feature f less every threshold in [t_lo, t_hi] is in the signed domain
+static bool comparable(const MatchingFeature<Field>& f, Field t_lo, Field t_hi) {
+    const Field half = Field(1) << (ED_DCF_DOMAIN_BITS - 1);
+    // the values are in [lo, hi]; the sums stop as soon as they leave twice the domain, so
+    // that they cannot overflow
+    Field c = f.range - 1;
+    Field scale = f.squared ? c * c : c;
+    Field lo = 0, hi = 0;
+    for (size_t i=0; i<f.dims; i++) {
+        Field w = f.weights.empty() ? Field(1) : f.weights[i];
+        Field abs_w = w < 0 ? -w : w;
+        if (scale > 0 && abs_w > 2 * half / scale) {
+            return false;
+        }
+        Field term = abs_w * scale;
+        if (!f.squared || w < 0) {
+            lo -= term;
+        }
+        if (!f.squared || w > 0) {
+            hi += term;
+        }
+        if (hi > 2 * half || lo < -2 * half) {
+            return false;
+        }
+    }
+    return hi - t_lo < half && lo - t_hi >= -half;
+}
 
-    std::vector<int> matchR(N, -1);
+void checkMatchingSpec(const MatchingSpec<Field>& spec, const std::vector<Field>& pair_bounds) {
+    size_t group = spec.groupSize();
+    if (group > 0 && pair_bounds.size() % group != 0) {
+        throw std::invalid_argument("Pair bounds must come in groups of one bound per feature.");
+    }
+    const Field half = Field(1) << (ED_DCF_DOMAIN_BITS - 1);
+    for (size_t i=0; i<group; i++) {
+        const auto& f = spec.features[i];
+        if (f.dims == 0 || (!f.weights.empty() && f.weights.size() != f.dims)) {
+            throw std::invalid_argument("Feature needs at least one coordinate and one weight per coordinate.");
+        }
+        if (f.range < 1 || f.range > half) {
+            throw std::invalid_argument("Coordinate range of a feature must be in [1, 2^(N-1)].");
+        }
+        // the distance buckets of a pair with bound b go down to b - bound
+        auto fits = [&](Field b) { return comparable(f, std::min(b, b - f.bound), std::max(b, b - f.bound)); };
+        if (f.bound > half || f.bound < -half || !fits(f.bound)) {
+            throw std::invalid_argument("Feature does not fit the domain of the comparisons.");
+        }
+        for (size_t k=i; k<pair_bounds.size(); k+=group) {
+            if (pair_bounds[k] > half || pair_bounds[k] < -half || !fits(pair_bounds[k])) {
+                throw std::invalid_argument("Pair bound does not fit the domain of the comparisons.");
+            }
+        }
+    }
+}
 
-    int result = 0; 
-    for (int u = 0; u < M; u++) {
-        std::vector<bool> seen(N,0);
+void checkCoordinates(const MatchingSpec<Field>& spec, const std::vector<Field>& coords) {
+    if (coords.size() != spec.inputLength()) {
+        throw std::invalid_argument("Expected one coordinate per dimension of the features.");
+    }
+    size_t j = 0;
+    for (const auto& f : spec.features) {
+        for (size_t i=0; i<f.dims; i++, j++) {
+            if (coords[j] < 0 || coords[j] >= f.range) {
+                throw std::invalid_argument("Coordinate out of the range of its feature.");
+            }
+        }
+    }
+}
 
-        if (bpm(bpGraph, u, seen, matchR))
-            result++;
+void checkFunshadeInputs(const std::vector<Field>& position, const std::vector<Field>& pair_bounds) {
+    if (position.size() != 4) {
+        throw std::invalid_argument("Expected the start (x, y) and end (x, y) coordinates.");
     }
-    return result;
+    for (Field coord : position) {
+        if (coord < 0 || coord >= (Field(1) << FUNSHADE_COORD_BITS)) {
+            throw std::invalid_argument("Coordinate out of the range of the funshade mode.");
+        }
+    }
+    for (Field bound : pair_bounds) {
+        if (bound < 0 || bound >= (Field(1) << 31)) {
+            throw std::invalid_argument("Pair bound out of the range of the funshade mode.");
+        }
+    }
+}
+
+// size of a maximum matching of a dense rider x driver graph
+int maxBPM(const std::vector<std::vector<bool>>& bpGraph) {
+    return matchingSize(hopcroftKarp(BitMatrix(bpGraph)));
 }
 }
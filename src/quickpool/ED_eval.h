@@ -3,11 +3,26 @@
 #include "ED_offline_eval.h"
 #include "ED_online_eval.h"
 #include "fss.h"
+#include "matching.h"
+#include "phase_stats.h"
 
 using namespace common::utils;
 
 #define START_MATCH_THRESHOLD (Field)50
 #define END_MATCH_THRESHOLD (Field)50
+// peak heap of SP per rider-driver pair of a tile (circuit, preprocessing, wires and keys), the
+// largest of all parties; about 5.7 KB measured by test/quickpool_memory.cpp, rounded up
+#define TILE_BYTES_PER_PAIR 8192
+// peak heap of SP per party for every tile whatever its size, for the bookkeeping indexed by
+// party; about 1 KB measured, rounded up
+#define TILE_BYTES_PER_PARTY 2048
+// length of the vectors whose scalar product is a squared distance in the funshade mode
+#define FUNSHADE_ED_LEN 4
+// coordinates of the funshade mode are below 2^FUNSHADE_COORD_BITS, so that the squared norms
+// and distances stay below 2^31 in its 32-bit ring
+#define FUNSHADE_COORD_BITS 15
+// most parties whose DCF output shares SP receives concurrently
+#define DCF_OUTPUT_RECEIVERS 64
 
 namespace quickpool {
 
@@ -18,16 +33,69 @@ class ED_eval {
     std::shared_ptr<io::NetIOMP> network_;
     LevelOrderedCircuit circ_;
     int security_param_;
-    int threads_;
+    std::shared_ptr<Executor> tpool_;
     int seed_;
+    bool local_matching_;
+    size_t buckets_;
+    MatchingSpec<Field> spec_;
+    std::vector<Field> pair_bounds_;
+    std::vector<int> assignment_;
+    std::shared_ptr<io::PhaseRecorder> phases_;
+    // threads on which SP receives the DCF output shares, created on first use
+    std::shared_ptr<ThreadPool> receivers_;
 
 public:
+    // evaluates on an executor of its own with the given number of threads, shared by all the
+    // evaluators it creates
     ED_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, LevelOrderedCircuit circ_, int security_param, int threads, int seed=200);
 
+    // evaluates on the given executor, e.g. Executor::global()
+    ED_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, LevelOrderedCircuit circ_, int security_param, std::shared_ptr<Executor> tpool, int seed=200);
+
     bool amIRider();
 
     bool amIDriver();
 
+    // enables/disables the maximal matching SP runs at the end of pair_EDMatching
+    void setLocalMatching(bool enable);
+
+    // number of distance buckets SP learns for every pair in pair_EDMatching (1 by default, only
+    // whether the pair is in range). A pair is in bucket k of buckets when its squared distance is
+    // in [T^2*k/buckets, T^2*(k+1)/buckets), so SP can minimize the sum of the start and end
+    // buckets of the matched pairs, at the cost of learning these coarse distances
+    void setDistanceBuckets(size_t buckets);
+
+    // features of the circuit given to the constructor, in the order of the outputs of every pair
+    // (the start and end points within START/END_MATCH_THRESHOLD by default); pair_EDMatching
+    // compares every output with the bound of its feature and a pair matches when all are below.
+    // Throws std::invalid_argument when the features do not fit the comparisons (see checkMatchingSpec)
+    void setMatchingSpec(const MatchingSpec<Field>& spec);
+
+    // bounds of every pair overriding those of the features of the matching spec, rider-major over
+    // all rider x driver pairs with groupSize() bounds per pair (empty for the bounds of the spec).
+    // Only SP needs them: they are folded into the DCF keys, so the parties compare the masked
+    // outputs as they are and changing the bounds costs no online work. The distance buckets
+    // keep the widths given by the bounds of the spec, below the bound of the pair. Throws
+    // std::invalid_argument when a bound does not fit the comparisons (see checkMatchingSpec)
+    void setPairBounds(std::vector<Field> bounds);
+
+    // bound of a feature of the pair of the given rider and driver (indices from 0)
+    Field pairBound(int rider, int driver, size_t feature) const;
+
+    // for every rider the index of its driver (or -1) in the matching SP computed last
+    const std::vector<int>& getAssignment() const;
+
+    // records the time, communication and rounds of every phase of pair_EDMatching in the given recorder
+    void setPhaseRecorder(std::shared_ptr<io::PhaseRecorder> recorder);
+
+    // threads on which SP receives the DCF output shares of the parties, see makeReceivers;
+    // evaluators of the same parties run one after the other can share them
+    void setReceivers(std::shared_ptr<ThreadPool> receivers);
+
+    // threads for SP to receive the DCF output shares of that many riders and drivers, one per
+    // party up to DCF_OUTPUT_RECEIVERS; they block on the network, so they are not the executor's
+    static std::shared_ptr<ThreadPool> makeReceivers(int rider_count, int driver_count);
+
     std::vector<Field> pair_matching(const std::unordered_map<wire_t, int>& input_pid_map, const std::unordered_map<wire_t, Field>& inputs, int rider_index, int driver_index);
 
     std::vector<Field> pair_matching(const std::unordered_map<wire_t, int>& input_pid_map, const std::unordered_map<wire_t, Field>& inputs);
@@ -36,11 +104,71 @@ public:
 
     std::vector<Field> pair_EDMatching(const std::unordered_map<wire_t, int>& input_pid_map, const std::unordered_map<wire_t, Field>& inputs);
 
-};
-
+    // matching among all riders and drivers, evaluated tile by tile so that a party only holds the
+    // circuit and preprocessing of tile_riders x tile_drivers pairs at a time; the circuit given
+    // to the constructor is not used, the one of the matching spec is generated for every tile
+    // from the own coordinates in position. SP gets the outputs of all pairs in row-major order.
+    std::vector<Field> pair_EDMatchingTiled(const std::vector<Field>& position, size_t tile_riders, size_t tile_drivers);
+
+    // matching among all riders and drivers with the funshade scalar product and sign gate instead
+    // of the circuit: |a-b|^2 is the scalar product of the rider's (a_x, a_y, |a|^2, 1) and the
+    // driver's (-2b_x, -2b_y, 1, |b|^2), so SP only deals correlated randomness and sign keys.
+    // Takes the own start (x, y) and end (x, y) position; the circuit given to the constructor
+    // and the matching spec are not used, the pair bounds if given are the squared start and end
+    // radii. SP gets the outputs of all pairs in row-major order. The ring is 32-bit: throws
+    // std::invalid_argument unless the coordinates are in [0, 2^15) and the bounds in [0, 2^31)
+    // (see checkFunshadeInputs).
+    std::vector<Field> pair_EDMatchingFunshade(const std::vector<Field>& position);
+
+    // memory SP holds whatever the tiles, its outputs and matching graph of all the pairs and
+    // the per-party bookkeeping of every tile (in bytes)
+    static size_t tileFixedBytes(int rider_count, int driver_count);
+
+    // side of the square tile whose pairs fit in the given memory budget (in bytes) of every
+    // party, next to the fixed memory of SP; at least 1 when the budget is too small
+    static size_t tileSide(size_t memory_budget, int rider_count, int driver_count);
 
-bool bpm(std::vector<std::vector<bool>> bpGraph, int u, std::vector<bool> seen, std::vector<int> matchR);
+};
 
-int maxBPM(std::vector<std::vector<bool>> bpGraph);
+// fills the inputs of generateEDSCircuit(rider_count, driver_count, pairs) with the own start (x, y)
+// and end (x, y) position of the party; the inputs of the other parties are set to 0
+void setEDSInputs(int rider_count, int driver_count, const std::vector<std::vector<bool>>& pairs,
+                  const std::vector<Field>& position, std::unordered_map<wire_t, int>& input_pid_map,
+                  std::unordered_map<wire_t, Field>& inputs);
+
+// fills the inputs of generateEDSSharedCircuit(rider_count, driver_count, pairs), or of
+// generateMatchingCircuit, with the own coordinates of the party (start (x, y) and end (x, y) for
+// the former), given once per party instead of once per pair
+void setEDSSharedInputs(int rider_count, int driver_count, const std::vector<Field>& position,
+                        std::unordered_map<wire_t, int>& input_pid_map, std::unordered_map<wire_t, Field>& inputs);
+
+// fills the inputs of generateBlockCircuit(rider_count, riders, drivers, spec) with the own
+// coordinates of party id, only touching the input wires of the block
+void setBlockInputs(int id, int rider_count, const std::vector<int>& riders, const std::vector<int>& drivers,
+                    const std::vector<Field>& position, std::unordered_map<wire_t, int>& input_pid_map,
+                    std::unordered_map<wire_t, Field>& inputs);
+
+
+// The comparisons of pair_EDMatching take the MSB of (value - threshold) in the signed
+// ED_DCF_DOMAIN_BITS-bit domain of the DCF keys, which is exact while the difference is in
+// [-2^(N-1), 2^(N-1)). This bounds the values of every feature over coordinates in [0, range)
+// against the thresholds, from the bound of the pair down to the lowest distance bucket: with
+// 24 bits the squared distances of 2-D points of the default spec need coordinates below 2048.
+// Throws std::invalid_argument when a feature of spec has no coordinates or not one weight per
+// coordinate, or when it or one of the bounds of pairs (groups of
+// spec.groupSize(), see ED_eval::setPairBounds) may leave the domain.
+void checkMatchingSpec(const MatchingSpec<Field>& spec, const std::vector<Field>& pair_bounds = {});
+
+// throws std::invalid_argument when the own coordinates of a party are out of the ranges of the
+// features of spec
+void checkCoordinates(const MatchingSpec<Field>& spec, const std::vector<Field>& coords);
+
+// throws std::invalid_argument when the start (x, y) and end (x, y) coordinates of position are
+// not in [0, 2^FUNSHADE_COORD_BITS) or a squared bound is not in [0, 2^31), where the funshade
+// sign gate would compare wrapped values
+void checkFunshadeInputs(const std::vector<Field>& position, const std::vector<Field>& pair_bounds = {});
+
+// size of a maximum matching, see hopcroftKarp for the assignment itself
+int maxBPM(const std::vector<std::vector<bool>>& bpGraph);
 
 }; // namespace quickpool
\ No newline at end of file
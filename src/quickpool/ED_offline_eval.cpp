@@ -1,4 +1,5 @@
 #include "ED_offline_eval.h"
+#include "fss.h"
 
 namespace quickpool {
 
@@ -13,13 +14,16 @@ OfflineEvaluator::OfflineEvaluator(int my_id, int rider_count, int driver_count,
       rgen_(my_id, seed), 
       network_(std::move(network)),
       circ_(std::move(circ)),
-      preproc_(circ.num_gates)
-      {tpool_ = std::make_shared<ThreadPool>(threads);}
+      preproc_(circ.num_gates),
+      driver_stream_(driver_count),
+      idx_driver_stream_(0),
+      stream_chunk_(OFFLINE_STREAM_CHUNK)
+      {tpool_ = std::make_shared<Executor>(threads);}
 
 OfflineEvaluator::OfflineEvaluator(int my_id, int rider_count, int driver_count,
                                    std::shared_ptr<io::NetIOMP> network,
                                    LevelOrderedCircuit circ,
-                                   int security_param, std::shared_ptr<ThreadPool> tpool, int seed)
+                                   int security_param, std::shared_ptr<Executor> tpool, int seed)
     : id_(my_id),
       rider_count(rider_count),
       driver_count(driver_count),
@@ -28,7 +32,10 @@ OfflineEvaluator::OfflineEvaluator(int my_id, int rider_count, int driver_count,
       network_(std::move(network)),
       circ_(std::move(circ)),
       preproc_(circ.num_gates),
-      tpool_(std::move(tpool)) {}
+      tpool_(std::move(tpool)),
+      driver_stream_(driver_count),
+      idx_driver_stream_(0),
+      stream_chunk_(OFFLINE_STREAM_CHUNK) {}
 
 // checking if the current party is a rider or not
 bool OfflineEvaluator::amIRider() {
@@ -50,6 +57,49 @@ bool OfflineEvaluator::isDealerDriver(int dealer) {
   return (dealer!=0 && dealer>rider_count);
 }
 
+void OfflineEvaluator::setStreamChunk(size_t chunk) {
+  stream_chunk_ = std::max<size_t>(chunk, 1);
+}
+
+// SP buffers a correction value for a driver and sends the buffer as soon as
+// it holds a full chunk, so that the driver can start consuming it while SP is
+// still generating the rest of the material
+void OfflineEvaluator::pushToDriver(int driver_id, Field val) {
+  auto& buffer = driver_stream_[driver_id-rider_count-1];
+  buffer.push_back(val);
+  if (buffer.size() >= stream_chunk_) {
+    flushToDriver(driver_id);
+  }
+}
+
+// SP sends the buffered correction values of a driver as one chunk, prefixed
+// by the number of values in it
+void OfflineEvaluator::flushToDriver(int driver_id) {
+  auto& buffer = driver_stream_[driver_id-rider_count-1];
+  if (buffer.empty()) {
+    return;
+  }
+  size_t len = buffer.size();
+  network_->send(driver_id, &len, sizeof(size_t));
+  network_->send(driver_id, buffer.data(), sizeof(Field) * len);
+  network_->flush(driver_id);
+  buffer.clear();
+}
+
+// driver reads the next correction value, receiving the next chunk from SP
+// when the current one has been consumed
+Field OfflineEvaluator::pullFromSP() {
+  auto& buffer = driver_stream_[id_-rider_count-1];
+  if (idx_driver_stream_ == buffer.size()) {
+    size_t len = 0;
+    network_->recv(0, &len, sizeof(size_t));
+    buffer.resize(len);
+    network_->recv(0, buffer.data(), sizeof(Field) * len);
+    idx_driver_stream_ = 0;
+  }
+  return buffer[idx_driver_stream_++];
+}
+
 // SP samples a random value and secret-shares among the rider and the driver
 void OfflineEvaluator::randomShare(int rider_id, int driver_id,
                                   RandGenPool& rgen, io::NetIOMP& network,
@@ -79,8 +129,7 @@ void OfflineEvaluator::randomShare(int rider_id, int driver_id,
 void OfflineEvaluator::randomShareSecret(int rider_id, int driver_id,
                                         RandGenPool& rgen, io::NetIOMP& network,
                                         AddShare<Field>& share, TPShare<Field>& tpShare,
-                                        Field secret, std::vector<std::vector<Field>>& rand_sh_sec, 
-                                        size_t& idx_rand_sh_sec) {
+                                        Field secret) {
   Field val = Field(0);
   Field valn = Field(0);
   
@@ -92,7 +141,7 @@ void OfflineEvaluator::randomShareSecret(int rider_id, int driver_id,
     tpShare.pushValues(val);
     valn = secret - val;
     tpShare.pushValues(valn);
-    rand_sh_sec[driver_id-rider_count-1].push_back(valn);
+    pushToDriver(driver_id, valn);
   }
   else if(id_ == rider_id) {
     // randomizeZZp(rgen.p0(), val, sizeof(Field));
@@ -100,8 +149,7 @@ void OfflineEvaluator::randomShareSecret(int rider_id, int driver_id,
     share.pushValue(val);
   }
   else if(id_ == driver_id) {
-    valn = rand_sh_sec[driver_id-rider_count-1][idx_rand_sh_sec];
-    idx_rand_sh_sec++;
+    valn = pullFromSP();
     share.pushValue(valn);
   }
 }
@@ -110,9 +158,7 @@ void OfflineEvaluator::randomShareSecret(int rider_id, int driver_id,
 void OfflineEvaluator::randomShareWithParty(int dealer, int rider_id,  
                                           int driver_id, RandGenPool& rgen,
                                           io::NetIOMP& network, AddShare<Field>& share,
-                                          TPShare<Field>& tpShare, Field& secret, 
-                                          std::vector<std::vector<Field>>& rand_sh_party, 
-                                          size_t& idx_rand_sh_party) {
+                                          TPShare<Field>& tpShare, Field& secret) {
                                              
                                             
   Field val = Field(0);
@@ -133,7 +179,7 @@ void OfflineEvaluator::randomShareWithParty(int dealer, int rider_id,
     randomize(rgen.pi(rider_id), val, sizeof(Field));
     tpShare.pushValues(val);
     valn = secret - val;
-    rand_sh_party[driver_id-rider_count-1].push_back(valn);
+    pushToDriver(driver_id, valn);
     tpShare.pushValues(valn);
   }
   else {
@@ -148,21 +194,35 @@ void OfflineEvaluator::randomShareWithParty(int dealer, int rider_id,
       share.pushValue(val);
     }
     else if (id_ == driver_id) {           
-      valn = rand_sh_party[driver_id-rider_count-1][idx_rand_sh_party];
-      idx_rand_sh_party++;
+      valn = pullFromSP();
       share.pushValue(valn);
     }
   }
 }
 
+// SP and dealer sample a common random mask for an input wire shared by all
+// the pairs of the dealer; the dealer holds the whole mask in each of its
+// pairs and the peer a zero share, so SP sends nothing to the drivers
+void OfflineEvaluator::sharedInputMask(int dealer, RandGenPool& rgen, AddShare<Field>& share,
+                                       TPShare<Field>& tpShare, Field& secret) {
+  if (id_ == 0) {
+    randomize(rgen.pi(dealer), secret, sizeof(Field));
+    share.pushValue(Field(0));
+    tpShare.pushValues(Field(0));
+    tpShare.pushValues(isDealerRider(dealer) ? secret : Field(0));
+    tpShare.pushValues(isDealerRider(dealer) ? Field(0) : secret);
+  }
+  else if (id_ == dealer) {
+    randomize(rgen.p0(), secret, sizeof(Field));
+    share.pushValue(secret);
+  }
+  else {
+    share.pushValue(Field(0));
+  }
+}
+
 void OfflineEvaluator::setWireMasksParty(
-                    const std::unordered_map<wire_t, int>& input_pid_map, 
-                    std::vector<std::vector<Field>>& rand_sh_sec,
-                    std::vector<std::vector<Field>>& rand_sh_party) {
-    
-  size_t idx_rand_sh_sec = 0;
-  size_t idx_rand_sh_party = 0;
-  
+                    const std::unordered_map<wire_t, int>& input_pid_map) {
   for (const auto& level : circ_.gates_by_level) {
     for (const auto& gate : level) {
       switch (gate->type) {
@@ -172,7 +232,12 @@ void OfflineEvaluator::setWireMasksParty(
           auto rider_id = gate->rider_id;
           auto driver_id = gate->driver_id;
           pregate->pid = dealer;
-          randomShareWithParty(dealer, rider_id, driver_id, rgen_, *network_, pregate->mask, pregate->tpmask, pregate->mask_value, rand_sh_party, idx_rand_sh_party);
+          if (circ_.input_peers.count(gate->out)) {
+            sharedInputMask(dealer, rgen_, pregate->mask, pregate->tpmask, pregate->mask_value);
+          }
+          else {
+            randomShareWithParty(dealer, rider_id, driver_id, rgen_, *network_, pregate->mask, pregate->tpmask, pregate->mask_value);
+          }
           preproc_.gates[gate->out] = std::move(pregate);
           break;
         }
@@ -234,7 +299,7 @@ void OfflineEvaluator::setWireMasksParty(
 
           TPShare<Field> tpmask_product;
           AddShare<Field> mask_product; 
-          randomShareSecret(rider_id, driver_id, rgen_, *network_, mask_product, tpmask_product, tp_prod, rand_sh_sec, idx_rand_sh_sec);
+          randomShareSecret(rider_id, driver_id, rgen_, *network_, mask_product, tpmask_product, tp_prod);
           preproc_.gates[gate->out] = std::move(std::make_unique<PreprocMultGate<Field>>
                               (rand_mask, tprand_mask, mask_product, tpmask_product));
           break;
@@ -257,7 +322,7 @@ void OfflineEvaluator::setWireMasksParty(
 
           TPShare<Field> tpmask_product;
           AddShare<Field> mask_product; 
-          randomShareSecret(rider_id, driver_id, rgen_, *network_, mask_product, tpmask_product, mask_prod, rand_sh_sec, idx_rand_sh_sec);
+          randomShareSecret(rider_id, driver_id, rgen_, *network_, mask_product, tpmask_product, mask_prod);
                                 
           preproc_.gates[gate->out] = std::move(std::make_unique<PreprocDotpGate<Field>>
                               (rand_mask, tprand_mask, mask_product, tpmask_product));
@@ -273,65 +338,78 @@ void OfflineEvaluator::setWireMasksParty(
 }
 
 
+// SP streams the correction values of every driver in chunks while it walks
+// the circuit, and each driver consumes them chunk by chunk during its own walk
 void OfflineEvaluator::setWireMasks(
   const std::unordered_map<wire_t, int>& input_pid_map) {
-    
-  std::vector<std::vector<Field>> rand_sh_sec(driver_count);
-  std::vector<std::vector<Field>> rand_sh_party(driver_count);
-      
-  if(!amIDriver()) {
-    setWireMasksParty(input_pid_map, rand_sh_sec, rand_sh_party);
-
-    if(id_ == 0) {
-      
-      for (int driver=0; driver<driver_count; driver++){
-        size_t rand_sh_sec_num = rand_sh_sec[driver].size();      
-        size_t rand_sh_party_num = rand_sh_party[driver].size();
-        size_t arith_comm = rand_sh_sec_num + rand_sh_party_num;
-      
-        std::vector<size_t> lengths(3);
-        lengths[0] = arith_comm;
-        lengths[1] = rand_sh_sec_num;
-        lengths[2] = rand_sh_party_num;
-
-        network_->send(driver+rider_count+1, lengths.data(), sizeof(size_t) * lengths.size());
-
-        std::vector<Field> offline_arith_comm(arith_comm);
-      
-        for(size_t i = 0; i < rand_sh_sec_num; i++) {
-          offline_arith_comm[i] = rand_sh_sec[driver][i];
-        }
-        for(size_t i = 0; i < rand_sh_party_num; i++) {
-          offline_arith_comm[rand_sh_sec_num + i] = rand_sh_party[driver][i];
-        }
-        network_->send(driver+rider_count+1, offline_arith_comm.data(), sizeof(Field) * arith_comm);
-      }
+  setWireMasksParty(input_pid_map);
+
+  if(id_ == 0) {
+    for (int driver=0; driver<driver_count; driver++) {
+      flushToDriver(driver+rider_count+1);
     }
   }
-  else {
-    std::vector<size_t> lengths(3);
-    network_->recv(0, lengths.data(), sizeof(size_t) * lengths.size());
+}
 
-    size_t arith_comm = lengths[0];
-    size_t rand_sh_sec_num = lengths[1];
-    size_t rand_sh_party_num = lengths[2];
+void OfflineEvaluator::setDCFKeys(const std::vector<Field>& offsets) {
+  size_t num_keys = circ_.outputs.size();
+  std::vector<size_t> lengths(rider_count + driver_count, 0);
+  for (auto wout : circ_.outputs) {
+    lengths[circ_.output_owners[wout][0] - 1]++;
+    lengths[circ_.output_owners[wout][1] - 1]++;
+  }
 
-    std::vector<Field> offline_arith_comm(arith_comm);
-    
-    network_->recv(0, offline_arith_comm.data(), sizeof(Field) * arith_comm);
+  if (id_ != 0) {
+    preproc_.dcf_keys.resize(lengths[id_ - 1] * EDBitComparison::KEY_LEN_);
+    network_->recv(0, preproc_.dcf_keys.data(), preproc_.dcf_keys.size() * sizeof(uint8_t));
+    return;
+  }
 
-    rand_sh_sec[id_-rider_count-1].resize(rand_sh_sec_num);
-    for(int i = 0; i < rand_sh_sec_num; i++) {
-      rand_sh_sec[id_-rider_count-1][i] = offline_arith_comm[i];
-    }
-    
-    rand_sh_party[id_-rider_count-1].resize(rand_sh_party_num);
-    for(int i = 0; i < rand_sh_party_num; i++) {
-      rand_sh_party[id_-rider_count-1][i] = offline_arith_comm[rand_sh_sec_num + i];
+  // every key is generated straight into its slot in the buffer of its party
+  std::vector<std::vector<uint8_t>> keys_for_parties(rider_count + driver_count);
+  for (size_t i = 0; i < keys_for_parties.size(); i++) {
+    keys_for_parties[i].resize(lengths[i] * EDBitComparison::KEY_LEN_);
+  }
+  std::vector<uint64_t> alpha(num_keys);
+  std::vector<uint8_t*> k_rider(num_keys), k_driver(num_keys);
+  std::vector<size_t> index(rider_count + driver_count, 0);
+  for (size_t i = 0; i < num_keys; i++) {
+    auto wout = circ_.outputs[i];
+    int rider_id = circ_.output_owners[wout][0];
+    int driver_id = circ_.output_owners[wout][1];
+    alpha[i] = preproc_.gates[wout]->tpmask.secret() + (offsets.empty() ? Field(0) : offsets[i]);
+    k_rider[i] = keys_for_parties[rider_id - 1].data() + (index[rider_id - 1]++) * EDBitComparison::KEY_LEN_;
+    k_driver[i] = keys_for_parties[driver_id - 1].data() + (index[driver_id - 1]++) * EDBitComparison::KEY_LEN_;
+  }
+
+  // all randomness is sampled at once, the keys are generated in chunks on the thread pool
+  std::vector<uint8_t> s_rider(num_keys * S_LEN), s_driver(num_keys * S_LEN);
+  std::vector<uint8_t> z_rider(num_keys);
+  random_buffer(s_rider.data(), s_rider.size());
+  random_buffer(s_driver.data(), s_driver.size());
+  random_buffer(z_rider.data(), z_rider.size());
+  size_t workers = std::max(tpool_->size(), 1);
+  size_t chunk = std::max<size_t>(AES_LANES, (num_keys + 4 * workers - 1) / (4 * workers));
+  std::vector<std::future<void>> res;
+  for (size_t start = 0; start < num_keys; start += chunk) {
+    res.push_back(tpool_->enqueue([&, start]() {
+      size_t n = std::min(chunk, num_keys - start);
+      EDBitComparison::gen_batch_seeded(n, &alpha[start], &k_rider[start], &k_driver[start],
+                                     &s_rider[start * S_LEN], &s_driver[start * S_LEN], &z_rider[start]);
+    }));
+  }
+  for (auto& r : res) {
+    r.get();
+  }
+
+  // parties without comparisons in the circuit are not involved
+  for (int i = 1; i <= rider_count + driver_count; i++) {
+    if (keys_for_parties[i - 1].empty()) {
+      continue;
     }
-    
-    setWireMasksParty(input_pid_map, rand_sh_sec, rand_sh_party);
-  }  
+    network_->send(i, keys_for_parties[i - 1].data(), keys_for_parties[i - 1].size() * sizeof(uint8_t));
+    network_->flush(i);
+  }
 }
 
 PreprocCircuit<Field> OfflineEvaluator::getPreproc() {
@@ -4,12 +4,31 @@
 #include "helpers.h"
 #include "preproc.h"
 #include "circuit.h"
+#include "executor.h"
 #include "rand_gen_pool.h"
+#include "dcf.h"
 
 using namespace common::utils;
 
+// Number of correction values the SP batches into one message to a driver
+// while streaming the offline material.
+#define OFFLINE_STREAM_CHUNK 1024
+
+// Bit-width of the domain of the distance comparisons. Squared distances of
+// coordinates in [0, 2048) and the thresholds fit in 23 bits, so their
+// differences are exact in 24-bit two's complement.
+#ifndef ED_DCF_DOMAIN_BITS
+#define ED_DCF_DOMAIN_BITS 24
+#endif
+
 namespace quickpool {
 
+// Comparison of a masked distance against zero, with Field-sized output shares.
+using EDComparison = MSB_gate<ED_DCF_DOMAIN_BITS, uint64_t>;
+// Same comparison over Z_2^8. The least significant bits of the two output shares
+// are an XOR sharing of the result, so owners only need to reveal one bit each.
+using EDBitComparison = MSB_gate<ED_DCF_DOMAIN_BITS, uint8_t>;
+
 class OfflineEvaluator {  
   int id_;
   int rider_count;
@@ -18,8 +37,24 @@ class OfflineEvaluator {
   RandGenPool rgen_;
   std::shared_ptr<io::NetIOMP> network_;
   LevelOrderedCircuit circ_;
-  std::shared_ptr<ThreadPool> tpool_;
+  std::shared_ptr<Executor> tpool_;
   PreprocCircuit<Field> preproc_;
+  // SP: pending correction values for each driver.
+  // Driver: the chunk of correction values most recently received from SP.
+  std::vector<std::vector<Field>> driver_stream_;
+  size_t idx_driver_stream_;
+  size_t stream_chunk_;
+
+  // SP appends a correction value to the stream of a driver and ships it once
+  // a full chunk is available.
+  void pushToDriver(int driver_id, Field val);
+
+  // SP ships the pending correction values of a driver.
+  void flushToDriver(int driver_id);
+
+  // Driver takes the next correction value, receiving a new chunk from SP
+  // when the current one is used up.
+  Field pullFromSP();
 
  public:
   
@@ -29,7 +64,7 @@ class OfflineEvaluator {
 
   OfflineEvaluator(int my_id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network,
                    LevelOrderedCircuit circ, int security_param,
-                   std::shared_ptr<ThreadPool> tpool, int seed = 200); 
+                   std::shared_ptr<Executor> tpool, int seed = 200); 
 
   bool amIRider();
 
@@ -51,23 +86,36 @@ class OfflineEvaluator {
   void randomShareSecret(int rider_id, int driver_id,
                         RandGenPool& rgen, io::NetIOMP& network,
                         AddShare<Field>& share, TPShare<Field>& tpShare,
-                        Field secret, std::vector<std::vector<Field>>& rand_sh_sec, size_t& idx_rand_sh_sec);
+                        Field secret);
 
 
   void randomShareWithParty(int dealer, int rider_id, int driver_id,
                                   RandGenPool& rgen, io::NetIOMP& network, AddShare<Field>& share,
-                                  TPShare<Field>& tpShare, Field& secret, std::vector<std::vector<Field>>& rand_sh_party,          
-                                  size_t& idx_rand_sh_party);
-                                          
-                                           
+                                  TPShare<Field>& tpShare, Field& secret);
+
+  // Mask of an input wire shared by all the pairs of the dealer: known to SP
+  // and the dealer only, with a zero share for the peers.
+  void sharedInputMask(int dealer, RandGenPool& rgen, AddShare<Field>& share,
+                       TPShare<Field>& tpShare, Field& secret);
+
+  // Set the number of correction values sent to a driver per message.
+  void setStreamChunk(size_t chunk);
+
 
   // Following methods implement various preprocessing subprotocols.
 
   // Set masks for each wire. Should be called before running any of the other
   // subprotocols.
-  void setWireMasksParty(const std::unordered_map<wire_t, int>& input_pid_map, std::vector<std::vector<Field>>& rand_sh_sec, std::vector<std::vector<Field>>& rand_sh_party);
+  void setWireMasksParty(const std::unordered_map<wire_t, int>& input_pid_map);
 
   void setWireMasks(const std::unordered_map<wire_t, int>& input_pid_map);
+
+  // SP generates an EDBitComparison key pair per output wire, whose mask is the
+  // comparison point, and sends the halves to the two owners of the wire. The i-th of
+  // the offsets, if given, is added to the comparison point of the i-th output, so
+  // that the owners compare the masked value itself against a bound only SP knows.
+  // Should be called after setWireMasks.
+  void setDCFKeys(const std::vector<Field>& offsets = {});
   
   // void getOutputMasks(int pid, std::vector<Field>& output_mask);
 
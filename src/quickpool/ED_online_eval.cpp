@@ -16,13 +16,13 @@ OnlineEvaluator::OnlineEvaluator(int id, int rider_count, int driver_count,
         circ_(std::move(circ)),
         wires_(circ.num_gates) 
         {
-            tpool_ = std::make_shared<ThreadPool>(threads);
+            tpool_ = std::make_shared<Executor>(threads);
         }
 
 OnlineEvaluator::OnlineEvaluator(int id, int rider_count, int driver_count, 
                 std::shared_ptr<io::NetIOMP> network,
                 PreprocCircuit<Field> preproc, LevelOrderedCircuit circ,
-                int security_param, std::shared_ptr<ThreadPool> tpool, int seed)
+                int security_param, std::shared_ptr<Executor> tpool, int seed)
     : 
         id_(id),
         rider_count(rider_count),
@@ -49,19 +49,39 @@ std::vector<Field> OnlineEvaluator::getwires() {
     return wires_;
 }
 
+const std::vector<Field>& OnlineEvaluator::wires() const {
+    return wires_;
+}
+
 // perform online phase for the Input gates    
-void OnlineEvaluator::setInputs(const std::unordered_map<wire_t, Field> &inputs) {
-    std::vector<Field> masked_values;
+template <class F>
+void OnlineEvaluator::setInputsWith(F input) {
+    // masked values of the shared input wires are sent as one message per peer
+    std::vector<std::vector<Field>> shared_out(rider_count+driver_count);
+    std::vector<std::vector<wire_t>> shared_in(rider_count+driver_count);
     // Input gates have depth 0
     for (auto &g : circ_.gates_by_level[0]) {
         if (g->type == GateType::kInp) {
             auto *pre_input = static_cast<PreprocInput<Field> *>(preproc_.gates[g->out].get());
             auto pid = pre_input->pid;
+            auto shared = circ_.input_peers.find(g->out);
+            if (shared != circ_.input_peers.end()) {
+                if (id_ == pid) {
+                    wires_[g->out] = pre_input->mask_value + input(g->out);
+                    for (auto peer : shared->second) {
+                        shared_out[peer-1].push_back(wires_[g->out]);
+                    }
+                }
+                else if (id_ != 0 && std::find(shared->second.begin(), shared->second.end(), id_) != shared->second.end()) {
+                    shared_in[pid-1].push_back(g->out);
+                }
+                continue;
+            }
             auto rider_id = g->rider_id;
             auto driver_id = g->driver_id;
             if (id_ == pid || id_==rider_id || id_==driver_id) {
                 if (id_ == pid) {
-                    wires_[g->out] = pre_input->mask_value + inputs.at(g->out);
+                    wires_[g->out] = pre_input->mask_value + input(g->out);
                     if(pid == rider_id) {                        
                         network_->send(driver_id, &wires_[g->out], sizeof(Field));
                     }
@@ -80,6 +100,35 @@ void OnlineEvaluator::setInputs(const std::unordered_map<wire_t, Field> &inputs)
             }
         }
     }
+
+    for (size_t peer = 0; peer < shared_out.size(); peer++) {
+        if (!shared_out[peer].empty()) {
+            network_->send(peer+1, shared_out[peer].data(), sizeof(Field) * shared_out[peer].size());
+            network_->flush(peer+1);
+        }
+    }
+    std::vector<Field> received;
+    for (size_t pid = 0; pid < shared_in.size(); pid++) {
+        if (!shared_in[pid].empty()) {
+            received.resize(shared_in[pid].size());
+            network_->recv(pid+1, received.data(), sizeof(Field) * received.size());
+            for (size_t i = 0; i < received.size(); i++) {
+                wires_[shared_in[pid][i]] = received[i];
+            }
+        }
+    }
+}
+
+void OnlineEvaluator::setInputs(const std::unordered_map<wire_t, Field> &inputs) {
+    setInputsWith([&inputs](wire_t w) { return inputs.at(w); });
+}
+
+void OnlineEvaluator::setInputs(const std::vector<Field> &inputs) {
+    setInputsWith([&inputs](wire_t w) { return inputs.at(w); });
+}
+
+void OnlineEvaluator::setPreproc(PreprocCircuit<Field> preproc) {
+    preproc_ = std::move(preproc);
 }
 
 void OnlineEvaluator::setRandomInputs() { // Incomplete
@@ -308,31 +357,52 @@ void OnlineEvaluator::evaluateGatesAtDepth(size_t depth) {
     }
 }
 
-// output reconstruction
+// output reconstruction: every rider sends SP the masked values of all its outputs in one
+// message, in the order of the outputs
 std::vector<Field> OnlineEvaluator::getOutputs() {
     std::vector<Field> outvals(circ_.outputs.size());
     if (circ_.outputs.empty()) {
         return outvals;
     }
 
-    for (size_t i = 0; i < circ_.outputs.size(); ++i) {
-        auto wout = circ_.outputs[i];
-        int rider_id = circ_.output_owners[wout][0];
-        if (id_ !=0) {
-            Field maksed_val = wires_[wout];
-            if (id_==rider_id){
-                network_->send(0, &maksed_val, sizeof(Field));
-            }                
+    if (id_ != 0) {
+        std::vector<Field> masked_vals;
+        for (auto wout : circ_.outputs) {
+            if (id_ == circ_.output_owners[wout][0]) {
+                masked_vals.push_back(wires_[wout]);
+            }
+        }
+        if (!masked_vals.empty()) {
+            network_->send(0, masked_vals.data(), masked_vals.size() * sizeof(Field));
+            network_->flush(0);
         }
-        else {
-            // network_->flush();
-            network_->flush(rider_count, driver_count);
-            network_->recv(rider_id, &outvals[i], sizeof(Field));
-            Field outmask = preproc_.gates[wout]->tpmask.secret();
-            outvals[i] -=  outmask;
+        return outvals;
+    }
+
+    std::vector<std::vector<Field>> masked_vals(rider_count);
+    for (auto wout : circ_.outputs) {
+        masked_vals[circ_.output_owners[wout][0] - 1].emplace_back();
+    }
+    network_->flush(rider_count, driver_count);
+    for (int rider = 0; rider < rider_count; rider++) {
+        if (!masked_vals[rider].empty()) {
+            network_->recv(rider + 1, masked_vals[rider].data(), masked_vals[rider].size() * sizeof(Field));
         }
     }
 
+    // SP puts the masked values and the masks in the order of the outputs and unmasks them at once
+    std::vector<Field> outmasks(circ_.outputs.size());
+    std::vector<size_t> index(rider_count, 0);
+    for (size_t i = 0; i < circ_.outputs.size(); ++i) {
+        auto wout = circ_.outputs[i];
+        int rider = circ_.output_owners[wout][0] - 1;
+        outvals[i] = masked_vals[rider][index[rider]++];
+        outmasks[i] = preproc_.gates[wout]->tpmask.secret();
+    }
+    for (size_t i = 0; i < outvals.size(); ++i) {
+        outvals[i] -= outmasks[i];
+    }
+
     return outvals;
 }
 
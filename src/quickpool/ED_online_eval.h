@@ -4,6 +4,7 @@
 #include "helpers.h"
 #include "preproc.h"
 #include "circuit.h"
+#include "executor.h"
 #include "rand_gen_pool.h"
 
 using namespace common::utils;
@@ -22,7 +23,11 @@ class OnlineEvaluator
   PreprocCircuit<Field> preproc_;
   LevelOrderedCircuit circ_;
   std::vector<Field> wires_;
-  std::shared_ptr<ThreadPool> tpool_;
+  std::shared_ptr<Executor> tpool_;
+
+  // input gates of the circuit, own inputs read with input(wire)
+  template <class F>
+  void setInputsWith(F input);
 
   // write reconstruction function
 public:
@@ -34,7 +39,7 @@ public:
   OnlineEvaluator(int id, int rider_count, int driver_count, 
                   std::shared_ptr<io::NetIOMP> network,
                   PreprocCircuit<Field> preproc, LevelOrderedCircuit circ,
-                  int security_param, std::shared_ptr<ThreadPool> tpool, int seed = 200);
+                  int security_param, std::shared_ptr<Executor> tpool, int seed = 200);
 
   bool amIRider();
 
@@ -43,8 +48,17 @@ public:
                   
   std::vector<Field> getwires();
 
+  // non-owning view of the masked values of all wires, valid as long as the evaluator
+  const std::vector<Field>& wires() const;
+
   void setInputs(const std::unordered_map<wire_t, Field> &inputs);
 
+  // same with the own input of wire w at inputs[w], for circuits whose input wires come first
+  void setInputs(const std::vector<Field> &inputs);
+
+  // replaces the preprocessing material, to evaluate the circuit once more without a new evaluator
+  void setPreproc(PreprocCircuit<Field> preproc);
+
   void setRandomInputs();
 
   void evaluateGatesAtDepthPartySend(size_t depth,
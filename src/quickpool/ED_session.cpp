@@ -0,0 +1,156 @@
+#include "ED_session.h"
+
+#include <algorithm>
+
+namespace quickpool {
+
+ED_session::ED_session(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, int threads, int seed)
+    : id_(id),
+    rider_count(rider_count),
+    driver_count(driver_count),
+    network_(network),
+    security_param_(security_param),
+    tpool_(std::make_shared<Executor>(threads)),
+    seed_(seed),
+    active_riders_(rider_count, false),
+    active_drivers_(driver_count, false),
+    position_(4, 0),
+    match_(id == 0 ? rider_count : 0, std::vector<bool>(driver_count, false)),
+    receivers_(id == 0 ? ED_eval::makeReceivers(rider_count, driver_count) : nullptr)
+    { }
+
+ED_session::ED_session(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, std::shared_ptr<Executor> tpool, int seed)
+    : id_(id),
+    rider_count(rider_count),
+    driver_count(driver_count),
+    network_(network),
+    security_param_(security_param),
+    tpool_(std::move(tpool)),
+    seed_(seed),
+    active_riders_(rider_count, false),
+    active_drivers_(driver_count, false),
+    position_(4, 0),
+    match_(id == 0 ? rider_count : 0, std::vector<bool>(driver_count, false)),
+    receivers_(id == 0 ? ED_eval::makeReceivers(rider_count, driver_count) : nullptr)
+    { }
+
+void ED_session::setInputs(Field start_x, Field start_y, Field end_x, Field end_y) {
+    std::vector<Field> position = {start_x, start_y, end_x, end_y};
+    checkCoordinates(MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD), position);
+    position_ = std::move(position);
+}
+
+bool ED_session::isActive(int party_id) {
+    if (party_id<=0 || party_id>rider_count+driver_count) {
+        return false;
+    }
+    if (party_id<=rider_count) {
+        return active_riders_[party_id-1];
+    }
+    return active_drivers_[party_id-rider_count-1];
+}
+
+void ED_session::setPairBounds(std::vector<Field> bounds) {
+    checkMatchingSpec(MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD), bounds);
+    pair_bounds_ = std::move(bounds);
+}
+
+const std::vector<std::vector<bool>>& ED_session::getMatches() {
+    return match_;
+}
+
+// builds, preprocesses and evaluates the circuit of the pairs of the given riders and drivers only;
+// the parties of none of these pairs take no part
+std::vector<Field> ED_session::evaluatePairs(const std::vector<int>& riders, const std::vector<int>& drivers) {
+    if (riders.empty() || drivers.empty()) {
+        return {};
+    }
+    if (id_!=0 && std::find(riders.begin(), riders.end(), id_-1) == riders.end() &&
+        std::find(drivers.begin(), drivers.end(), id_-rider_count-1) == drivers.end()) {
+        return {};
+    }
+    auto spec = MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD);
+    auto circ = Circuit<Field>::generateBlockCircuit(rider_count, riders, drivers, spec);
+    std::unordered_map<wire_t, int> input_pid_map;
+    std::unordered_map<wire_t, Field> inputs;
+    setBlockInputs(id_, rider_count, riders, drivers, position_, input_pid_map, inputs);
+
+    ED_eval eval(id_, rider_count, driver_count, network_, circ.orderGatesByLevel(), security_param_, tpool_, seed_);
+    eval.setLocalMatching(false);
+    eval.setPairBounds(pair_bounds_);
+    eval.setReceivers(receivers_);
+    auto output = eval.pair_EDMatching(input_pid_map, inputs);
+
+    if (id_==0) {
+        for (size_t r=0, k=0; r<riders.size(); r++) {
+            for (size_t d=0; d<drivers.size(); d++, k++) {
+                match_[riders[r]][drivers[d]] = bool(output[k]);
+            }
+        }
+    }
+    return output;
+}
+
+std::vector<Field> ED_session::addRider(int rider_id) {
+    if (rider_id<1 || rider_id>rider_count) {
+        throw std::invalid_argument("Invalid rider id.");
+    }
+    if (active_riders_[rider_id-1]) {
+        throw std::runtime_error("Rider is already active.");
+    }
+    active_riders_[rider_id-1] = true;
+
+    std::vector<int> drivers;
+    for (int driver=0; driver<driver_count; driver++) {
+        if (active_drivers_[driver]) {
+            drivers.push_back(driver);
+        }
+    }
+    return evaluatePairs({rider_id-1}, drivers);
+}
+
+std::vector<Field> ED_session::addDriver(int driver_id) {
+    if (driver_id<=rider_count || driver_id>rider_count+driver_count) {
+        throw std::invalid_argument("Invalid driver id.");
+    }
+    int driver = driver_id-rider_count-1;
+    if (active_drivers_[driver]) {
+        throw std::runtime_error("Driver is already active.");
+    }
+    active_drivers_[driver] = true;
+
+    std::vector<int> riders;
+    for (int rider=0; rider<rider_count; rider++) {
+        if (active_riders_[rider]) {
+            riders.push_back(rider);
+        }
+    }
+    return evaluatePairs(riders, {driver});
+}
+
+// retiring a rider only drops its row of match bits, no interaction is needed
+void ED_session::removeRider(int rider_id) {
+    if (rider_id<1 || rider_id>rider_count) {
+        throw std::invalid_argument("Invalid rider id.");
+    }
+    active_riders_[rider_id-1] = false;
+    if (id_==0) {
+        std::fill(match_[rider_id-1].begin(), match_[rider_id-1].end(), false);
+    }
+}
+
+// retiring a driver only drops its column of match bits, no interaction is needed
+void ED_session::removeDriver(int driver_id) {
+    if (driver_id<=rider_count || driver_id>rider_count+driver_count) {
+        throw std::invalid_argument("Invalid driver id.");
+    }
+    int driver = driver_id-rider_count-1;
+    active_drivers_[driver] = false;
+    if (id_==0) {
+        for (auto& row : match_) {
+            row[driver] = false;
+        }
+    }
+}
+
+}; // namespace quickpool
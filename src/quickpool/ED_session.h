@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ED_eval.h"
+
+namespace quickpool {
+
+// Incremental end-point matching session over a fixed set of connected parties.
+// Riders and drivers join and leave over time; every event is known to all parties,
+// which call the same method in the same order. A join only creates, preprocesses
+// and evaluates the circuit of the new row (rider) or column (driver) of pairs
+// against the currently active counterparts, so the per-event cost is O(D) or O(R)
+// instead of regenerating the full R x D circuit. SP keeps the match bits of the
+// evaluated pairs and retires a row or column when its party leaves.
+class ED_session {
+    int id_;
+    int rider_count;
+    int driver_count;
+    std::shared_ptr<io::NetIOMP> network_;
+    int security_param_;
+    std::shared_ptr<Executor> tpool_;
+    int seed_;
+    std::vector<bool> active_riders_;
+    std::vector<bool> active_drivers_;
+    std::vector<Field> position_;
+    // squared start and end radii of every pair, only used by SP
+    std::vector<Field> pair_bounds_;
+    // match bits between riders and drivers, only maintained by SP
+    std::vector<std::vector<bool>> match_;
+    // threads on which SP receives the DCF output shares of every event
+    std::shared_ptr<ThreadPool> receivers_;
+
+    std::vector<Field> evaluatePairs(const std::vector<int>& riders, const std::vector<int>& drivers);
+
+public:
+    // the evaluators of all events share one executor with the given number of threads
+    ED_session(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, int threads, int seed=200);
+
+    ED_session(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, std::shared_ptr<Executor> tpool, int seed=200);
+
+    // sets the own start (x, y) and end (x, y) positions of a rider or a driver, coordinates in
+    // [0, 2048) (see checkMatchingSpec)
+    void setInputs(Field start_x, Field start_y, Field end_x, Field end_y);
+
+    // squared start and end radii of all rider x driver pairs, rider-major (see
+    // ED_eval::setPairBounds); only SP needs them and they apply to the pairs evaluated afterwards
+    void setPairBounds(std::vector<Field> bounds);
+
+    // evaluates the new rider against all active drivers; SP gets one match bit per active driver
+    std::vector<Field> addRider(int rider_id);
+
+    // evaluates the new driver against all active riders; SP gets one match bit per active rider
+    std::vector<Field> addDriver(int driver_id);
+
+    void removeRider(int rider_id);
+
+    void removeDriver(int driver_id);
+
+    bool isActive(int party_id);
+
+    // match bits of all rider-driver pairs, inactive pairs are false (SP only)
+    const std::vector<std::vector<bool>>& getMatches();
+
+};
+
+}; // namespace quickpool
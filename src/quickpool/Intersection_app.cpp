@@ -33,7 +33,7 @@ int main() {
             auto network = std::make_shared<io::NetIOMP>(i, rider_count, driver_count, 10000, nullptr, true);
             
             // Create an instance of the Intersection_eval class
-            Intersection_eval iter_eval(i, rider_count, driver_count, network, SECURITY_PARAM, nP);
+            Intersection_eval iter_eval(i, rider_count, driver_count, network, SECURITY_PARAM, Executor::global());
 
             // Set inputs for non-zero parties
             if (0 < i && i <= rider_count) {
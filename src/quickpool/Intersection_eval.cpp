@@ -9,7 +9,16 @@ Intersection_eval::Intersection_eval(int id, int rider_count, int driver_count,
     network_(network),
     security_param_(security_param),
     rgen_(id, seed)
-    {tpool_ = std::make_shared<ThreadPool>(threads);}
+    {tpool_ = std::make_shared<Executor>(threads);}
+
+Intersection_eval::Intersection_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, std::shared_ptr<Executor> tpool, int seed) : 
+    id_(id), 
+    rider_count_(rider_count),
+    driver_count_(driver_count),
+    network_(network),
+    security_param_(security_param),
+    rgen_(id, seed),
+    tpool_(std::move(tpool)) {}
 
 void Intersection_eval::setInputs() {
     if (id_!=0) {
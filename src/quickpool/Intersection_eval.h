@@ -16,12 +16,14 @@ class Intersection_eval {
     std::shared_ptr<io::NetIOMP> network_;
     int security_param_;
     RandGenPool rgen_;
-    std::shared_ptr<ThreadPool> tpool_;
+    std::shared_ptr<Executor> tpool_;
     std::vector<uint64_t> routes;
 
 public:
     Intersection_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, int threads, int seed=200);
 
+    Intersection_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, std::shared_ptr<Executor> tpool, int seed=200);
+
     void setInputs();
 
     std::vector<uint64_t> getInputs();
@@ -30,7 +30,16 @@ Intersection_eval::Intersection_eval(int id, int rider_count, int driver_count,
     network_(network),
     security_param_(security_param),
     rgen_(id, seed)
-    {tpool_ = std::make_shared<ThreadPool>(threads);}
+    {tpool_ = std::make_shared<Executor>(threads);}
+
+Intersection_eval::Intersection_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, std::shared_ptr<Executor> tpool, int seed) : 
+    id_(id), 
+    rider_count_(rider_count),
+    driver_count_(driver_count),
+    network_(network),
+    security_param_(security_param),
+    rgen_(id, seed),
+    tpool_(std::move(tpool)) {}
 
 // Function to convert bsoncxx type to string for better logging
 std::string bson_type_to_string(bsoncxx::type type) {
@@ -357,42 +366,50 @@ std::vector<std::vector<bool>> Intersection_eval::processIntersectionMatching(){
     else { // I am SP
         std::cout << "start intersection for SP id: " << id_ << std::endl;
         // std::vector<std::vector<bool>> match(rider_count_, std::vector<bool>(driver_count_));
-        emp::block *prf_results_riders = new emp::block[rider_count_*driver_count_*VERTEX_NUM];
-        emp::block *prf_results_drivers = new emp::block[rider_count_*driver_count_*VERTEX_NUM];
-        for (size_t i=1; i<=rider_count_; i++) { // receive from riders
-            network_->recv(i, prf_results_riders+(i-1)*driver_count_*VERTEX_NUM, driver_count_*VERTEX_NUM*sizeof(emp::block));
-        }
-        for (size_t i=1; i<=driver_count_; i++) { // receive from drivers
-            network_->recv(i+rider_count_, prf_results_drivers+(i-1)*rider_count_*VERTEX_NUM, rider_count_*VERTEX_NUM*sizeof(emp::block));
-        }
-        std::cout << "mid intersection for SP id: " << id_ << " recieve all data for intersection" << std::endl;
-        // for each pair of rider and driver check if the match_count is greater than threshold or not
-        for (size_t i=0; i<rider_count_; i++) {
-            for (size_t j=0; j<driver_count_; j++) {
-                // count number of common values
-                int match_count=0;
-                size_t r_index = i*driver_count_*VERTEX_NUM+j*VERTEX_NUM;
-                size_t d_index = j*rider_count_*VERTEX_NUM+i*VERTEX_NUM;
-                for (size_t k=0; k<VERTEX_NUM; k++) {
-                    emp::block r_elem = prf_results_riders[r_index+k];
-                    for (size_t l=0; l<VERTEX_NUM; l++) {
-                        emp::block d_elem = prf_results_drivers[d_index+l];
-                        if (emp::cmpBlock(&r_elem, &d_elem, 1))
-                            match_count++; 
-                    }
+        // SP consumes the PRF results tile by tile: rider streams are ordered by driver and driver
+        // streams by rider, so reading the tiles in row-major order keeps every stream in order
+        // while only tile x tile x VERTEX_NUM blocks per side are buffered
+        size_t tile = INTERSECTION_TILE;
+        emp::block *prf_results_riders = new emp::block[tile*tile*VERTEX_NUM];
+        emp::block *prf_results_drivers = new emp::block[tile*tile*VERTEX_NUM];
+        for (size_t r0=0; r0<rider_count_; r0+=tile) {
+            size_t r1 = std::min<size_t>(r0+tile, rider_count_);
+            for (size_t d0=0; d0<driver_count_; d0+=tile) {
+                size_t d1 = std::min<size_t>(d0+tile, driver_count_);
+                size_t tile_r = r1-r0, tile_d = d1-d0;
+                for (size_t i=r0; i<r1; i++) { // receive from riders
+                    network_->recv(i+1, prf_results_riders+(i-r0)*tile_d*VERTEX_NUM, tile_d*VERTEX_NUM*sizeof(emp::block));
                 }
-                std::cout << "match count for rider id: " << i << " and driver id " << j << ": " << match_count << std::endl;
-                // check if the count is higher than threshold or not
-                if (match_count>DRIVER_RIDER_MATCH_THRESHOLD) {
-                    output.push_back(1);
-                    match[i][j] = true;
+                for (size_t j=d0; j<d1; j++) { // receive from drivers
+                    network_->recv(j+1+rider_count_, prf_results_drivers+(j-d0)*tile_r*VERTEX_NUM, tile_r*VERTEX_NUM*sizeof(emp::block));
                 }
-                else {
-                    output.push_back(0);
-                    match[i][j] = false;
+                // for each pair of rider and driver check if the match_count is greater than threshold or not
+                for (size_t i=r0; i<r1; i++) {
+                    for (size_t j=d0; j<d1; j++) {
+                        // count number of common values
+                        int match_count=0;
+                        size_t r_index = (i-r0)*tile_d*VERTEX_NUM+(j-d0)*VERTEX_NUM;
+                        size_t d_index = (j-d0)*tile_r*VERTEX_NUM+(i-r0)*VERTEX_NUM;
+                        for (size_t k=0; k<VERTEX_NUM; k++) {
+                            emp::block r_elem = prf_results_riders[r_index+k];
+                            for (size_t l=0; l<VERTEX_NUM; l++) {
+                                emp::block d_elem = prf_results_drivers[d_index+l];
+                                if (emp::cmpBlock(&r_elem, &d_elem, 1))
+                                    match_count++; 
+                            }
+                        }
+                        std::cout << "match count for rider id: " << i << " and driver id " << j << ": " << match_count << std::endl;
+                        // check if the count is higher than threshold or not
+                        match[i][j] = match_count>DRIVER_RIDER_MATCH_THRESHOLD;
+                    }
                 }
             }
         }
+        for (size_t i=0; i<rider_count_; i++) {
+            for (size_t j=0; j<driver_count_; j++) {
+                output.push_back(match[i][j]);
+            }
+        }
         std::cout << "mid intersection for SP id: " << id_ << " get all possible matches" << std::endl;
         delete[] prf_results_riders;
         delete[] prf_results_drivers;
@@ -5,6 +5,8 @@
 
 #define DRIVER_RIDER_MATCH_THRESHOLD 0
 #define VERTEX_NUM 400
+// number of riders and drivers whose PRF results SP buffers at a time
+#define INTERSECTION_TILE 64
 
 namespace quickpool {
 
@@ -15,12 +17,14 @@ class Intersection_eval {
     std::shared_ptr<io::NetIOMP> network_;
     int security_param_;
     RandGenPool rgen_;
-    std::shared_ptr<ThreadPool> tpool_;
+    std::shared_ptr<Executor> tpool_;
     emp::block routes[VERTEX_NUM];
 
 public:
     Intersection_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, int threads, int seed=200);
 
+    Intersection_eval(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network, int security_param, std::shared_ptr<Executor> tpool, int seed=200);
+
     emp::block* fetchRoutesFromDB(const std::string& role, int id_);
 
     emp::block* getRiderInputs(int rider_id);
@@ -0,0 +1,432 @@
+#include "matching.h"
+
+#include <atomic>
+#include <future>
+#include <limits>
+#include <queue>
+
+// frontiers of fewer riders are expanded on the calling thread
+#define MATCHING_PARALLEL_FRONTIER 256
+// edges of the connected components solved by one task of minCostAssignment
+#define ASSIGNMENT_TASK_EDGES 4096
+
+namespace quickpool {
+
+BitMatrix::BitMatrix(size_t rows, size_t cols)
+    : rows_(rows),
+      cols_(cols),
+      words_((cols + 63) / 64),
+      bits_(rows * words_, 0) {}
+
+BitMatrix::BitMatrix(const std::vector<std::vector<bool>>& dense)
+    : BitMatrix(dense.size(), dense.empty() ? 0 : dense[0].size()) {
+    for (size_t r = 0; r < rows_; r++) {
+        for (size_t c = 0; c < cols_; c++) {
+            if (dense[r][c]) {
+                set(r, c);
+            }
+        }
+    }
+}
+
+// claims the unvisited drivers adjacent to frontier[begin, end) and puts the riders
+// matched to them in the next layer; returns true if a free driver was reached
+static bool expandLayer(const BitMatrix& adj, const std::vector<int>& frontier, size_t begin, size_t end,
+                        int layer, std::vector<std::atomic<uint64_t>>& unvisited,
+                        const std::vector<int>& match_driver, std::vector<int>& dist, std::vector<int>& next) {
+    bool found = false;
+    for (size_t i = begin; i < end; i++) {
+        const uint64_t* row = adj.row(frontier[i]);
+        for (size_t w = 0; w < adj.words(); w++) {
+            uint64_t bits = row[w] & unvisited[w].load(std::memory_order_relaxed);
+            if (bits == 0) {
+                continue;
+            }
+            // with several threads only the one that clears a bit owns the driver
+            bits &= unvisited[w].fetch_and(~bits, std::memory_order_relaxed);
+            for (; bits != 0; bits &= bits - 1) {
+                int rider = match_driver[w * 64 + __builtin_ctzll(bits)];
+                if (rider < 0) {
+                    found = true;
+                }
+                else {
+                    dist[rider] = layer + 1;
+                    next.push_back(rider);
+                }
+            }
+        }
+    }
+    return found;
+}
+
+std::vector<int> hopcroftKarp(const BitMatrix& adj, common::utils::Executor* tpool) {
+    return hopcroftKarp(adj, std::vector<int>(adj.rows(), -1), tpool);
+}
+
+std::vector<int> hopcroftKarp(const BitMatrix& adj, const std::vector<int>& initial, common::utils::Executor* tpool) {
+    const int INF = std::numeric_limits<int>::max();
+    const size_t rows = adj.rows(), words = adj.words();
+    std::vector<int> match_rider(initial), match_driver(adj.cols(), -1);
+
+    // valid driver bits of a row
+    std::vector<uint64_t> all_drivers(words, ~uint64_t(0));
+    if (adj.cols() % 64 != 0) {
+        all_drivers[words - 1] = (uint64_t(1) << (adj.cols() % 64)) - 1;
+    }
+
+    // the initial matching, extended greedily with the first free driver of every free rider
+    std::vector<uint64_t> free_drivers = all_drivers;
+    for (size_t u = 0; u < rows; u++) {
+        if (match_rider[u] >= 0) {
+            match_driver[match_rider[u]] = u;
+            free_drivers[match_rider[u] / 64] &= ~(uint64_t(1) << (match_rider[u] % 64));
+        }
+    }
+    for (size_t u = 0; u < rows; u++) {
+        if (match_rider[u] >= 0) {
+            continue;
+        }
+        const uint64_t* row = adj.row(u);
+        for (size_t w = 0; w < words; w++) {
+            uint64_t bits = row[w] & free_drivers[w];
+            if (bits != 0) {
+                int v = w * 64 + __builtin_ctzll(bits);
+                match_rider[u] = v;
+                match_driver[v] = u;
+                free_drivers[w] &= ~(bits & -bits);
+                break;
+            }
+        }
+    }
+
+    std::vector<int> dist(rows);
+    std::vector<std::atomic<uint64_t>> unvisited(words);
+    std::vector<uint64_t> avail(words);
+    std::vector<int> frontier, next;
+    // DFS stack of riders with the next driver to try, and the drivers leading to them
+    std::vector<std::pair<int, size_t>> stack;
+    std::vector<int> path;
+
+    while (true) {
+        // BFS from the free riders, layer by layer, up to the first layer reaching a free driver
+        frontier.clear();
+        for (size_t u = 0; u < rows; u++) {
+            dist[u] = match_rider[u] < 0 ? 0 : INF;
+            if (match_rider[u] < 0) {
+                frontier.push_back(u);
+            }
+        }
+        for (size_t w = 0; w < words; w++) {
+            unvisited[w].store(all_drivers[w], std::memory_order_relaxed);
+        }
+
+        bool found = false;
+        for (int layer = 0; !frontier.empty() && !found; layer++) {
+            next.clear();
+            if (tpool == nullptr || tpool->size() <= 1 || frontier.size() < MATCHING_PARALLEL_FRONTIER) {
+                found = expandLayer(adj, frontier, 0, frontier.size(), layer, unvisited, match_driver, dist, next);
+            }
+            else {
+                size_t chunks = tpool->size();
+                size_t chunk = (frontier.size() + chunks - 1) / chunks;
+                std::vector<std::vector<int>> nexts(chunks);
+                std::vector<std::future<bool>> res;
+                for (size_t c = 0; c < chunks; c++) {
+                    size_t begin = std::min(c * chunk, frontier.size());
+                    size_t end = std::min(begin + chunk, frontier.size());
+                    res.push_back(tpool->enqueue([&, c, begin, end]() {
+                        return expandLayer(adj, frontier, begin, end, layer, unvisited, match_driver, dist, nexts[c]);
+                    }));
+                }
+                for (size_t c = 0; c < chunks; c++) {
+                    found |= res[c].get();
+                    next.insert(next.end(), nexts[c].begin(), nexts[c].end());
+                }
+            }
+            if (found) {
+                // longer paths are left to the next phase
+                for (int u : next) {
+                    dist[u] = INF;
+                }
+            }
+            frontier.swap(next);
+        }
+        if (!found) {
+            break;
+        }
+
+        // DFS from every free rider along the layers over the drivers visited by the BFS; a
+        // driver that is traversed once is dropped for the rest of the phase, which keeps the
+        // augmenting paths vertex-disjoint. Free drivers were only reached from the last layer.
+        for (size_t w = 0; w < words; w++) {
+            avail[w] = all_drivers[w] & ~unvisited[w].load(std::memory_order_relaxed);
+        }
+        for (size_t s = 0; s < rows; s++) {
+            if (match_rider[s] >= 0) {
+                continue;
+            }
+            stack.assign(1, {int(s), 0});
+            path.clear();
+            while (!stack.empty()) {
+                auto& [u, pos] = stack.back();
+                const uint64_t* row = adj.row(u);
+                int v = -1;
+                for (size_t w = pos / 64; w < words && v < 0; w++) {
+                    uint64_t bits = row[w] & avail[w];
+                    if (w == pos / 64) {
+                        bits &= ~uint64_t(0) << (pos % 64);
+                    }
+                    for (; bits != 0 && v < 0; bits &= bits - 1) {
+                        int cand = w * 64 + __builtin_ctzll(bits);
+                        int rider = match_driver[cand];
+                        if (rider < 0 || dist[rider] == dist[u] + 1) {
+                            v = cand;
+                        }
+                    }
+                }
+                if (v < 0) {
+                    // dead end for the rest of the phase
+                    dist[u] = INF;
+                    stack.pop_back();
+                    if (!path.empty()) {
+                        path.pop_back();
+                    }
+                    continue;
+                }
+                pos = v + 1;
+                avail[v / 64] &= ~(uint64_t(1) << (v % 64));
+                path.push_back(v);
+                if (match_driver[v] >= 0) {
+                    stack.push_back({match_driver[v], 0});
+                    continue;
+                }
+                // augmenting path: every rider on the stack takes the driver after it
+                for (size_t i = 0; i < stack.size(); i++) {
+                    match_rider[stack[i].first] = path[i];
+                    match_driver[path[i]] = stack[i].first;
+                }
+                break;
+            }
+        }
+    }
+    return match_rider;
+}
+
+// Min-cost matching of maximum size of one connected component, with successive shortest
+// augmenting paths. The potentials keep every reduced cost c - pot_rider - pot_driver >= 0 and
+// the matched edges tight; each round a Dijkstra from all free riders, stopped at the first free
+// driver, raises the potentials so that all shortest augmenting paths become tight, and a DFS
+// augments a maximal set of vertex-disjoint paths over the tight edges.
+static std::vector<int> componentAssignment(size_t riders, size_t drivers, const std::vector<size_t>& offsets,
+                                            const std::vector<int>& adj_driver, const std::vector<int64_t>& adj_cost) {
+    const int64_t INF = std::numeric_limits<int64_t>::max();
+    std::vector<int> match_rider(riders, -1), match_driver(drivers, -1);
+    // the free riders keep equal potentials, as the largest ones, for every matching to be
+    // of minimum cost among those of its size
+    std::vector<int64_t> pot_rider(riders, 0), pot_driver(drivers, 0);
+    auto tight = [&](size_t u, size_t e) {
+        return adj_cost[e] - pot_rider[u] - pot_driver[adj_driver[e]] == 0;
+    };
+
+    std::vector<int64_t> dist_rider(riders), dist_driver(drivers);
+    std::vector<bool> used(drivers);
+    std::vector<std::pair<int, size_t>> stack;
+    std::vector<int> path;
+    std::priority_queue<std::pair<int64_t, int>, std::vector<std::pair<int64_t, int>>, std::greater<>> heap;
+    while (true) {
+        // vertex-disjoint augmenting paths over the tight edges, a driver is tried once per round
+        std::fill(used.begin(), used.end(), false);
+        for (size_t s = 0; s < riders; s++) {
+            if (match_rider[s] >= 0) {
+                continue;
+            }
+            stack.assign(1, {int(s), offsets[s]});
+            path.clear();
+            while (!stack.empty()) {
+                auto& [u, e] = stack.back();
+                while (e < offsets[u + 1] && (used[adj_driver[e]] || !tight(u, e))) {
+                    e++;
+                }
+                if (e == offsets[u + 1]) {
+                    stack.pop_back();
+                    if (!path.empty()) {
+                        path.pop_back();
+                    }
+                    continue;
+                }
+                int v = adj_driver[e++];
+                used[v] = true;
+                path.push_back(v);
+                if (match_driver[v] >= 0) {
+                    stack.push_back({match_driver[v], offsets[match_driver[v]]});
+                    continue;
+                }
+                for (size_t i = 0; i < stack.size(); i++) {
+                    match_rider[stack[i].first] = path[i];
+                    match_driver[path[i]] = stack[i].first;
+                }
+                break;
+            }
+        }
+
+        // reduced distances from the free riders, up to the shortest augmenting path
+        std::fill(dist_rider.begin(), dist_rider.end(), INF);
+        std::fill(dist_driver.begin(), dist_driver.end(), INF);
+        for (size_t u = 0; u < riders; u++) {
+            if (match_rider[u] < 0) {
+                dist_rider[u] = 0;
+                heap.push({0, int(u)});
+            }
+        }
+        int64_t shortest = INF;
+        while (!heap.empty()) {
+            auto [d, u] = heap.top();
+            heap.pop();
+            if (d >= shortest) {
+                break;
+            }
+            if (d > dist_rider[u]) {
+                continue;
+            }
+            for (size_t e = offsets[u]; e < offsets[u + 1]; e++) {
+                int v = adj_driver[e];
+                int64_t nd = d + adj_cost[e] - pot_rider[u] - pot_driver[v];
+                if (v == match_rider[u] || nd >= dist_driver[v]) {
+                    continue;
+                }
+                dist_driver[v] = nd;
+                int w = match_driver[v];
+                if (w < 0) {
+                    shortest = std::min(shortest, nd);
+                }
+                else if (nd < dist_rider[w]) {
+                    dist_rider[w] = nd;
+                    heap.push({nd, w});
+                }
+            }
+        }
+        heap = {};
+        if (shortest == INF) {
+            break;
+        }
+        for (size_t u = 0; u < riders; u++) {
+            if (dist_rider[u] < shortest) {
+                pot_rider[u] += shortest - dist_rider[u];
+            }
+        }
+        for (size_t v = 0; v < drivers; v++) {
+            if (dist_driver[v] < shortest) {
+                pot_driver[v] -= shortest - dist_driver[v];
+            }
+        }
+    }
+    return match_rider;
+}
+
+static int findRoot(std::vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        x = parent[x] = parent[parent[x]];
+    }
+    return x;
+}
+
+std::vector<int> minCostAssignment(size_t riders, size_t drivers, const std::vector<CostEdge>& edges,
+                                   common::utils::Executor* tpool) {
+    // connected components of the riders [0, riders) and the drivers after them
+    std::vector<int> parent(riders + drivers);
+    for (size_t x = 0; x < parent.size(); x++) {
+        parent[x] = x;
+    }
+    for (const auto& e : edges) {
+        parent[findRoot(parent, e.rider)] = findRoot(parent, riders + e.driver);
+    }
+    std::vector<int> component(riders + drivers, -1), local(riders + drivers);
+    std::vector<std::vector<int>> comp_riders, comp_drivers;
+    std::vector<std::vector<CostEdge>> comp_edges;
+    for (const auto& e : edges) {
+        int root = findRoot(parent, e.rider);
+        if (component[root] < 0) {
+            component[root] = comp_edges.size();
+            comp_riders.emplace_back();
+            comp_drivers.emplace_back();
+            comp_edges.emplace_back();
+        }
+        comp_edges[component[root]].push_back(e);
+    }
+    // local indices of the riders and drivers within their component
+    std::vector<bool> seen(riders + drivers, false);
+    for (size_t c = 0; c < comp_edges.size(); c++) {
+        for (auto& e : comp_edges[c]) {
+            if (!seen[e.rider]) {
+                seen[e.rider] = true;
+                local[e.rider] = comp_riders[c].size();
+                comp_riders[c].push_back(e.rider);
+            }
+            if (!seen[riders + e.driver]) {
+                seen[riders + e.driver] = true;
+                local[riders + e.driver] = comp_drivers[c].size();
+                comp_drivers[c].push_back(e.driver);
+            }
+        }
+    }
+
+    std::vector<int> assignment(riders, -1);
+    auto solve = [&](size_t c) {
+        size_t n = comp_riders[c].size();
+        std::vector<size_t> offsets(n + 1, 0);
+        for (auto& e : comp_edges[c]) {
+            offsets[local[e.rider] + 1]++;
+        }
+        for (size_t u = 0; u < n; u++) {
+            offsets[u + 1] += offsets[u];
+        }
+        std::vector<int> adj_driver(comp_edges[c].size());
+        std::vector<int64_t> adj_cost(comp_edges[c].size());
+        std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (auto& e : comp_edges[c]) {
+            size_t k = fill[local[e.rider]]++;
+            adj_driver[k] = local[riders + e.driver];
+            adj_cost[k] = e.cost;
+        }
+        auto match = componentAssignment(n, comp_drivers[c].size(), offsets, adj_driver, adj_cost);
+        for (size_t u = 0; u < n; u++) {
+            if (match[u] >= 0) {
+                assignment[comp_riders[c][u]] = comp_drivers[c][match[u]];
+            }
+        }
+    };
+
+    if (tpool == nullptr || tpool->size() <= 1) {
+        for (size_t c = 0; c < comp_edges.size(); c++) {
+            solve(c);
+        }
+        return assignment;
+    }
+    // small components are grouped into tasks of about ASSIGNMENT_TASK_EDGES edges
+    std::vector<std::future<void>> res;
+    for (size_t begin = 0, end; begin < comp_edges.size(); begin = end) {
+        size_t task_edges = 0;
+        for (end = begin; end < comp_edges.size() && task_edges < ASSIGNMENT_TASK_EDGES; end++) {
+            task_edges += comp_edges[end].size();
+        }
+        res.push_back(tpool->enqueue([&solve, begin, end]() {
+            for (size_t c = begin; c < end; c++) {
+                solve(c);
+            }
+        }));
+    }
+    for (auto& r : res) {
+        r.get();
+    }
+    return assignment;
+}
+
+size_t matchingSize(const std::vector<int>& assignment) {
+    size_t size = 0;
+    for (int driver : assignment) {
+        size += driver >= 0;
+    }
+    return size;
+}
+
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "executor.h"
+
+namespace quickpool {
+
+// Dense bipartite adjacency of riders (rows) and drivers (columns), one bit per pair.
+// Every row is padded to whole 64-bit words so that rows can be scanned and masked a
+// word at a time.
+class BitMatrix {
+    size_t rows_;
+    size_t cols_;
+    size_t words_;
+    std::vector<uint64_t> bits_;
+
+public:
+    BitMatrix(size_t rows = 0, size_t cols = 0);
+
+    explicit BitMatrix(const std::vector<std::vector<bool>>& dense);
+
+    size_t rows() const { return rows_; }
+
+    size_t cols() const { return cols_; }
+
+    // number of 64-bit words per row
+    size_t words() const { return words_; }
+
+    bool get(size_t row, size_t col) const {
+        return (bits_[row * words_ + col / 64] >> (col % 64)) & 1;
+    }
+
+    void set(size_t row, size_t col, bool value = true) {
+        uint64_t mask = uint64_t(1) << (col % 64);
+        auto& word = bits_[row * words_ + col / 64];
+        word = value ? (word | mask) : (word & ~mask);
+    }
+
+    const uint64_t* row(size_t row) const { return &bits_[row * words_]; }
+
+    uint64_t* row(size_t row) { return &bits_[row * words_]; }
+};
+
+// Maximum matching of the bipartite graph with Hopcroft-Karp: a greedy initial matching,
+// then phases of a BFS that layers the graph from the free riders and a DFS that augments
+// along vertex-disjoint shortest paths. Both run over the words of the rows, so that a
+// visited or used driver is dropped for a whole phase with a single mask. The BFS layers
+// are split over the thread pool when one is given. Returns for every rider the index of
+// its driver, or -1 if it is unmatched.
+std::vector<int> hopcroftKarp(const BitMatrix& adj, common::utils::Executor* tpool = nullptr);
+
+// same as above, warm-started from a matching of the graph (for every rider its driver or -1),
+// e.g. one grown greedily while the edges were arriving; only its free riders are augmented
+std::vector<int> hopcroftKarp(const BitMatrix& adj, const std::vector<int>& initial, common::utils::Executor* tpool = nullptr);
+
+// number of matched riders of an assignment returned by hopcroftKarp or minCostAssignment
+size_t matchingSize(const std::vector<int>& assignment);
+
+// a rider-driver pair that may be matched, at a non-negative integer cost
+struct CostEdge {
+    int rider;
+    int driver;
+    int64_t cost;
+};
+
+// Among the matchings of maximum size, one of minimum total cost (a sparse Hungarian method).
+// Every connected component is solved on its own with successive shortest augmenting paths,
+// augmenting all vertex-disjoint shortest paths found in a round at once; the components are
+// spread over the thread pool when one is given. Returns for every rider the index of its
+// driver, or -1 if it is unmatched.
+std::vector<int> minCostAssignment(size_t riders, size_t drivers, const std::vector<CostEdge>& edges,
+                                   common::utils::Executor* tpool = nullptr);
+
+};
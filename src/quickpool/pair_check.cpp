@@ -0,0 +1,135 @@
+#include "pair_check.h"
+
+#include <algorithm>
+
+namespace quickpool {
+
+PairCheck::PairCheck(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network,
+                     int rider_id, int driver_id, const MatchingSpec<Field>& spec, int security_param,
+                     std::shared_ptr<Executor> tpool, int seed)
+    : id_(id),
+    rider_count(rider_count),
+    driver_count(driver_count),
+    rider_id_(rider_id),
+    driver_id_(driver_id),
+    network_(std::move(network)),
+    spec_(spec),
+    security_param_(security_param),
+    tpool_(std::move(tpool)),
+    seed_(seed),
+    circ_(Circuit<Field>::generatePairCircuit(rider_id, driver_id, spec).orderGatesByLevel()),
+    prepared_(0)
+    {
+        checkMatchingSpec(spec_);
+        if (id_ == rider_id_ || id_ == driver_id_) {
+            online_ = std::make_unique<OnlineEvaluator>(id_, rider_count, driver_count, network_, PreprocCircuit<Field>(),
+                                                        circ_, security_param_, tpool_, seed_);
+            inputs_.assign(2 * spec_.inputLength(), Field(0));
+        }
+    }
+
+void PairCheck::setBounds(std::vector<Field> bounds) {
+    checkMatchingSpec(spec_, bounds);
+    bounds_ = std::move(bounds);
+}
+
+size_t PairCheck::prepared() const {
+    return prepared_;
+}
+
+// one offline phase over all copies, then the material of every copy is moved to a circuit of
+// its own, with the wires of the copy renumbered from 0
+void PairCheck::prepare(size_t checks) {
+    if (checks == 0) {
+        return;
+    }
+    size_t len = spec_.inputLength();
+    size_t group = spec_.groupSize();
+    size_t W = circ_.num_gates;
+    auto batch = Circuit<Field>::generatePairCircuit(rider_id_, driver_id_, spec_, checks).orderGatesByLevel();
+    std::unordered_map<wire_t, int> input_pid_map;
+    for (size_t k = 0; k < checks; k++) {
+        for (size_t i = 0; i < 2 * len; i++) {
+            input_pid_map[k * W + i] = i < len ? rider_id_ : driver_id_;
+        }
+    }
+
+    OfflineEvaluator eval(id_, rider_count, driver_count, network_, batch, security_param_, tpool_, seed_);
+    eval.setWireMasks(input_pid_map);
+    std::vector<Field> offsets;
+    if (id_ == 0) {
+        for (size_t k = 0; k < checks; k++) {
+            for (size_t f = 0; f < group; f++) {
+                offsets.push_back(bounds_.empty() ? spec_.features[f].bound : bounds_[f]);
+            }
+        }
+    }
+    eval.setDCFKeys(offsets);
+    prepared_ += checks;
+    if (id_ == 0) {
+        return;
+    }
+
+    auto preproc = eval.getPreproc();
+    size_t key_len = group * EDBitComparison::KEY_LEN_;
+    for (size_t k = 0; k < checks; k++) {
+        PreprocCircuit<Field> material(W);
+        for (size_t w = 0; w < W; w++) {
+            material.gates[w] = std::move(preproc.gates[k * W + w]);
+        }
+        material.dcf_keys.assign(preproc.dcf_keys.begin() + k * key_len, preproc.dcf_keys.begin() + (k + 1) * key_len);
+        material_.push_back(std::move(material));
+    }
+}
+
+Field PairCheck::check(const std::vector<Field>& coords) {
+    if (id_ != 0) {
+        checkCoordinates(spec_, coords);
+    }
+    if (prepared_ == 0) {
+        throw std::runtime_error("No prepared check left.");
+    }
+    prepared_--;
+    size_t group = spec_.groupSize();
+
+    if (id_ == 0) {
+        // the XOR of the shares of the rider and of the driver, one bit per feature
+        uint64_t share_rider = 0, share_driver = 0;
+        network_->recv(rider_id_, &share_rider, sizeof(uint64_t));
+        network_->recv(driver_id_, &share_driver, sizeof(uint64_t));
+        uint64_t all = group == 64 ? ~uint64_t(0) : (uint64_t(1) << group) - 1;
+        return Field(((share_rider ^ share_driver) & all) == all);
+    }
+
+    auto material = std::move(material_.front());
+    material_.pop_front();
+    std::vector<uint8_t> keys = std::move(material.dcf_keys);
+
+    // the own coordinates go to the input wires of this party in the copy
+    size_t len = spec_.inputLength();
+    size_t first = id_ == rider_id_ ? 0 : len;
+    std::copy(coords.begin(), coords.end(), inputs_.begin() + first);
+
+    online_->setPreproc(std::move(material));
+    online_->setInputs(inputs_);
+    for (size_t i = 0; i < circ_.gates_by_level.size(); ++i) {
+        online_->evaluateGatesAtDepth(i);
+    }
+
+    // the bounds are folded into the keys, the masked outputs are compared as they are
+    std::vector<uint64_t> x_hat(group);
+    for (size_t f = 0; f < group; f++) {
+        x_hat[f] = uint64_t(online_->wires()[circ_.outputs[f]]);
+    }
+    std::vector<uint8_t> comp_output(group);
+    EDBitComparison::eval_batch(group, id_ == driver_id_, keys.data(), x_hat.data(), comp_output.data());
+    uint64_t share = 0;
+    for (size_t f = 0; f < group; f++) {
+        share |= uint64_t(comp_output[f] & 1) << f;
+    }
+    network_->send(0, &share, sizeof(uint64_t));
+    network_->flush(0);
+    return Field(0);
+}
+
+}; // namespace quickpool
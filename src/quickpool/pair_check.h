@@ -0,0 +1,65 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+
+#include "ED_eval.h"
+
+namespace quickpool {
+
+// Low-latency re-check of a single rider-driver pair, e.g. after a route change. The circuit
+// of the pair is compiled once, and SP deals the masks and DCF keys of a batch of checks ahead
+// of time with prepare. A check then only runs the online phase on cached material. The rider
+// and the driver exchange their masked coordinates and their dot product shares, evaluate the
+// DCF keys locally and send SP one message each, from which SP learns the match bit. That is
+// two round trips between the rider and the driver, plus one message to SP, on one evaluator
+// reused by all the checks. Only SP, the rider
+// and the driver take part, calling the same methods in the same order. The spec may have at
+// most 64 features.
+class PairCheck {
+    int id_;
+    int rider_count;
+    int driver_count;
+    int rider_id_;
+    int driver_id_;
+    std::shared_ptr<io::NetIOMP> network_;
+    MatchingSpec<Field> spec_;
+    // bounds of the features of the pair, only used by SP
+    std::vector<Field> bounds_;
+    int security_param_;
+    std::shared_ptr<Executor> tpool_;
+    int seed_;
+    // circuit of one check
+    LevelOrderedCircuit circ_;
+    // material of the prepared checks, consumed in order (only its count for SP)
+    std::deque<PreprocCircuit<Field>> material_;
+    size_t prepared_;
+    // evaluator of the checks of the rider and of the driver, given the material of every check,
+    // and its inputs: the own coordinates on the input wires of the party, 0 on the others
+    std::unique_ptr<OnlineEvaluator> online_;
+    std::vector<Field> inputs_;
+
+public:
+    PairCheck(int id, int rider_count, int driver_count, std::shared_ptr<io::NetIOMP> network,
+              int rider_id, int driver_id, const MatchingSpec<Field>& spec, int security_param,
+              std::shared_ptr<Executor> tpool, int seed = 200);
+
+    // bounds of the features of the pair (see ED_eval::setPairBounds), folded into the DCF keys
+    // of the checks prepared afterwards; only SP needs them
+    void setBounds(std::vector<Field> bounds);
+
+    // preprocesses the given number of checks in one batch: one circuit of that many copies of
+    // the pair, a single stream of corrections to the driver and one message of keys per party
+    void prepare(size_t checks);
+
+    // number of prepared checks not used yet
+    size_t prepared() const;
+
+    // checks the pair on the own coordinates of the rider and of the driver (ignored for SP) with
+    // the material of the next prepared check, so that it only runs the online phase; throws
+    // std::runtime_error when none is left. SP gets 1 for a match and 0 otherwise, the rider and
+    // the driver get 0
+    Field check(const std::vector<Field>& coords);
+};
+
+}; // namespace quickpool
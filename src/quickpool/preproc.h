@@ -61,6 +61,9 @@ struct PreprocDotpGate : public PreprocGate<R> {
 template <class R>
 struct PreprocCircuit {
   std::vector<preprocg_ptr_t<R>> gates;
+  // EDBitComparison keys (EDBitComparison::KEY_LEN_ bytes each) of the comparisons on the output wires owned
+  // by the party, in the order of the circuit outputs. Empty for SP.
+  std::vector<uint8_t> dcf_keys;
 
   PreprocCircuit() = default;
   PreprocCircuit(size_t num_gates) : gates(num_gates) {}      
@@ -85,17 +85,61 @@ struct LevelOrderedCircuit {
   std::array<uint64_t, GateType::NumGates> count;
   std::vector<wire_t> outputs;
   std::unordered_map<wire_t, std::vector<int>> output_owners;
+  // parties that read an input wire shared by all the pairs of its owner
+  std::unordered_map<wire_t, std::vector<int>> input_peers;
   std::vector<std::vector<gate_ptr_t>> gates_by_level;
 
   friend std::ostream& operator<<(std::ostream& os,
                                   const LevelOrderedCircuit& circ);
 };
 
+// A criterion a rider-driver pair is matched on, computed from dims coordinates
+// of the rider and of the driver: the weighted squared distance
+// sum_i w_i (r_i - d_i)^2, or the weighted difference sum_i w_i (r_i - d_i)
+// when squared is false. The pair meets the criterion when the value is below
+// bound, e.g. a pickup time window T is {1, {}, T*T} and enough free seats,
+// with the rider's seats against the driver's, is {1, {}, 1, false}. The
+// coordinates are in [0, range), which bounds the values to compare.
+template <class R>
+struct MatchingFeature {
+  size_t dims;
+  std::vector<R> weights;  // one per coordinate, all 1 when empty
+  R bound;
+  bool squared = true;
+  R range = 2048;
+};
+
+// The features of a matching, in the order of the coordinates every party
+// inputs and of the outputs of every pair.
+template <class R>
+struct MatchingSpec {
+  std::vector<MatchingFeature<R>> features;
+
+  // number of coordinates input by every party
+  size_t inputLength() const {
+    size_t len = 0;
+    for (const auto& f : features) {
+      len += f.dims;
+    }
+    return len;
+  }
+
+  // number of outputs of every pair, one per feature
+  size_t groupSize() const { return features.size(); }
+
+  // start (x, y) and end (x, y) points closer than the given distances
+  static MatchingSpec endpoints(R start_threshold, R end_threshold) {
+    return {{{2, {}, start_threshold * start_threshold},
+             {2, {}, end_threshold * end_threshold}}};
+  }
+};
+
 // Represents an arithmetic circuit.
 template <class R>
 class Circuit {
   std::vector<wire_t> outputs_;
   std::unordered_map<wire_t, std::vector<int>> output_owners_;
+  std::unordered_map<wire_t, std::vector<int>> input_peers_;
   std::vector<gate_ptr_t> gates_;
 
   bool isWireValid(wire_t wid) { return wid < gates_.size(); }
@@ -117,6 +161,15 @@ class Circuit {
     return wid;
   }
 
+  // input wire of a single party that is read by the pairs of the party with
+  // each of the peers, instead of one input wire per pair
+  wire_t newSharedInputWire(const std::vector<int>& peers) {
+    wire_t wid = gates_.size();
+    gates_.push_back(std::make_shared<Gate>(GateType::kInp, wid));
+    input_peers_[wid] = peers;
+    return wid;
+  }
+
   void setAsOutput(wire_t wid) {
     if (!isWireValid(wid)) {
       throw std::invalid_argument("Invalid wire ID.");
@@ -243,6 +296,7 @@ class Circuit {
     LevelOrderedCircuit res;
     res.outputs = outputs_;
     res.output_owners = output_owners_;
+    res.input_peers = input_peers_;
     res.num_gates = gates_.size();
 
     // Map from output wire id to multiplicative depth/level.
@@ -381,6 +435,15 @@ class Circuit {
   }
      
   static Circuit generateEDSCircuit(int rider_count, int driver_count) {
+    std::vector<std::vector<bool>> candidates(rider_count, std::vector<bool>(driver_count, true));
+    return generateEDSCircuit(rider_count, driver_count, candidates);
+  }
+
+  // same as above, but only instantiates the gates of the candidate pairs;
+  // wires of a pair are laid out as rs0, re0, ds0, de0, rs1, re1, ds1, de1
+  // followed by the 6 wires of the subtraction and dot product gates
+  static Circuit generateEDSCircuit(int rider_count, int driver_count,
+                                    const std::vector<std::vector<bool>>& candidates) {
     Circuit circ;    
     
     std::vector<wire_t> rider_start_loc(2);
@@ -394,6 +457,9 @@ class Circuit {
     for (int rider=0; rider<rider_count; rider++) {
       int rider_id = rider+1;
       for (int driver=0; driver<driver_count; driver++) {
+        if (!candidates[rider][driver]) {
+          continue;
+        }
         int driver_id = driver+rider_count+1;
         for(int i = 0; i < 2; ++i) {
           rider_start_loc[i] = circ.newInputWire(rider_id, driver_id);
@@ -414,6 +480,143 @@ class Circuit {
 
     return circ;
   }
+
+  // same as above, but every party inputs its start and end points once and
+  // the pairs read them from shared input wires; party p owns the wires
+  // 4(p-1) .. 4(p-1)+3 holding (sx, sy, ex, ey), followed by the 6 wires of
+  // the subtraction and dot product gates of every candidate pair
+  static Circuit generateEDSSharedCircuit(int rider_count, int driver_count,
+                                          const std::vector<std::vector<bool>>& candidates) {
+    // the bounds of the features are only used by the evaluator
+    return generateMatchingCircuit(rider_count, driver_count, candidates, MatchingSpec<R>::endpoints(R(0), R(0)));
+  }
+
+  // Circuit of the features of spec for the candidate pairs. Every party inputs
+  // its L = spec.inputLength() coordinates once, party p owning the shared input
+  // wires L(p-1) .. L(p-1)+L-1 in the order of the features, followed by the
+  // gates of the candidate pairs. The outputs of a pair are adjacent, one per
+  // feature, and the pairs are in row-major order.
+  static Circuit generateMatchingCircuit(int rider_count, int driver_count,
+                                         const std::vector<std::vector<bool>>& candidates,
+                                         const MatchingSpec<R>& spec) {
+    Circuit circ;
+
+    std::vector<std::vector<int>> peers(rider_count + driver_count);
+    for (int rider=0; rider<rider_count; rider++) {
+      for (int driver=0; driver<driver_count; driver++) {
+        if (candidates[rider][driver]) {
+          peers[rider].push_back(driver+rider_count+1);
+          peers[rider_count+driver].push_back(rider+1);
+        }
+      }
+    }
+
+    std::vector<std::vector<wire_t>> coords(rider_count + driver_count, std::vector<wire_t>(spec.inputLength()));
+    for (size_t party=0; party<coords.size(); party++) {
+      for (auto& wid : coords[party]) {
+        wid = circ.newSharedInputWire(peers[party]);
+      }
+    }
+
+    for (int rider=0; rider<rider_count; rider++) {
+      for (int driver=0; driver<driver_count; driver++) {
+        if (candidates[rider][driver]) {
+          addPairGates(circ, rider+1, driver+rider_count+1, coords[rider], coords[rider_count+driver], spec);
+        }
+      }
+    }
+
+    return circ;
+  }
+
+  // Same as above for all pairs of the given riders and drivers (indices from 0),
+  // without looking at the other parties: the riders own the shared input wires
+  // from 0 on and the drivers those after them, L per party in the order of the
+  // lists, followed by the gates of the pairs in row-major order. The work and
+  // the size of the circuit only depend on the number of pairs of the block.
+  static Circuit generateBlockCircuit(int rider_count, const std::vector<int>& riders,
+                                      const std::vector<int>& drivers, const MatchingSpec<R>& spec) {
+    Circuit circ;
+
+    std::vector<int> rider_ids, driver_ids;
+    for (int rider : riders) {
+      rider_ids.push_back(rider+1);
+    }
+    for (int driver : drivers) {
+      driver_ids.push_back(driver+rider_count+1);
+    }
+
+    size_t len = spec.inputLength();
+    std::vector<std::vector<wire_t>> coords(riders.size() + drivers.size(), std::vector<wire_t>(len));
+    for (size_t i=0; i<coords.size(); i++) {
+      for (auto& wid : coords[i]) {
+        wid = circ.newSharedInputWire(i < riders.size() ? driver_ids : rider_ids);
+      }
+    }
+
+    for (size_t r=0; r<riders.size(); r++) {
+      for (size_t d=0; d<drivers.size(); d++) {
+        addPairGates(circ, rider_ids[r], driver_ids[d], coords[r], coords[riders.size()+d], spec);
+      }
+    }
+
+    return circ;
+  }
+
+  // Circuit of the features of spec for the single pair of the given rider and
+  // driver, repeated copies times: copy k takes the W wires from kW on, the L =
+  // spec.inputLength() coordinates of the rider and then those of the driver
+  // followed by the gates, and its outputs are the k-th group of outputs.
+  static Circuit generatePairCircuit(int rider_id, int driver_id, const MatchingSpec<R>& spec,
+                                     size_t copies = 1) {
+    Circuit circ;
+    std::vector<wire_t> rider_coords(spec.inputLength());
+    std::vector<wire_t> driver_coords(spec.inputLength());
+    for (size_t k=0; k<copies; k++) {
+      for (auto& wid : rider_coords) {
+        wid = circ.newSharedInputWire({driver_id});
+      }
+      for (auto& wid : driver_coords) {
+        wid = circ.newSharedInputWire({rider_id});
+      }
+      addPairGates(circ, rider_id, driver_id, rider_coords, driver_coords, spec);
+    }
+    return circ;
+  }
+
+ private:
+  // gates and outputs of the features of spec between the coordinates of a rider and a driver
+  static void addPairGates(Circuit& circ, int rider_id, int driver_id, const std::vector<wire_t>& rider_coords,
+                           const std::vector<wire_t>& driver_coords, const MatchingSpec<R>& spec) {
+    std::vector<wire_t> diff;
+    std::vector<wire_t> weighted;
+    size_t offset = 0;
+    for (const auto& f : spec.features) {
+      if (f.dims == 0) {
+        throw std::invalid_argument("Feature without coordinates.");
+      }
+      diff.resize(f.dims);
+      weighted.resize(f.dims);
+      for (size_t i=0; i<f.dims; i++) {
+        diff[i] = circ.addGate(GateType::kSub, rider_coords[offset+i], driver_coords[offset+i], rider_id, driver_id);
+        weighted[i] = (f.weights.empty() || f.weights[i] == R(1))
+                          ? diff[i]
+                          : circ.addConstOpGate(GateType::kConstMul, diff[i], f.weights[i], rider_id, driver_id);
+      }
+      wire_t out;
+      if (f.squared) {
+        out = circ.addGate(GateType::kDotprod, diff, weighted, rider_id, driver_id);
+      }
+      else {
+        out = weighted[0];
+        for (size_t i=1; i<f.dims; i++) {
+          out = circ.addGate(GateType::kAdd, out, weighted[i], rider_id, driver_id);
+        }
+      }
+      circ.setAsOutput(out, rider_id, driver_id);
+      offset += f.dims;
+    }
+  }
 };
 
 };  // namespace common::utils
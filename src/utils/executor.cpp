@@ -0,0 +1,249 @@
+#include "executor.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace common::utils {
+
+namespace {
+
+// worker of the executor running on the current thread, if any
+thread_local const Executor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+std::mutex global_mutex;
+std::shared_ptr<Executor> global_executor;
+size_t global_threads = 0;
+bool global_pin = false;
+
+// parses a CPU list of sysfs such as "0-3,8,10-11"
+std::vector<int> parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void pinToCpu(std::thread& thread, int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set);
+#else
+  (void)thread;
+  (void)cpu;
+#endif
+}
+
+};  // namespace
+
+std::vector<std::vector<int>> numaNodes() {
+  std::vector<std::vector<int>> nodes;
+  for (int node = 0;; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!file) {
+      break;
+    }
+    std::string list;
+    std::getline(file, list);
+    auto cpus = parseCpuList(list);
+    if (!cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+    }
+  }
+  if (nodes.empty()) {
+    nodes.emplace_back();
+    for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1U); ++cpu) {
+      nodes[0].push_back(cpu);
+    }
+  }
+  return nodes;
+}
+
+Executor::Executor(size_t threads, bool pin) : since_ns_(nowNs()) {
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  // the workers are spread over the CPUs node by node, so that consecutive workers share a node
+  auto nodes = numaNodes();
+  std::vector<std::pair<int, int>> cpus;  // (node, cpu)
+  for (size_t node = 0; node < nodes.size(); ++node) {
+    for (int cpu : nodes[node]) {
+      cpus.push_back({int(node), cpu});
+    }
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    auto worker = std::make_unique<Worker>();
+    // evenly over all CPUs, several consecutive workers per CPU when there are more workers
+    auto [node, cpu] = cpus[i * cpus.size() / threads];
+    worker->node = node;
+    worker->cpu = pin ? cpu : -1;
+    workers_.push_back(std::move(worker));
+  }
+
+  // the workers of the own node come first, then the others, both in a rotated order so that
+  // idle workers do not all go for the same victim
+  victims_.resize(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    for (int pass = 0; pass < 2; ++pass) {
+      for (size_t k = 1; k < threads; ++k) {
+        size_t j = (i + k) % threads;
+        if ((workers_[j]->node == workers_[i]->node) == (pass == 0)) {
+          victims_[i].push_back(j);
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < threads; ++i) {
+    workers_[i]->thread = std::thread([this, i]() { run(i); });
+    if (workers_[i]->cpu >= 0) {
+      pinToCpu(workers_[i]->thread, workers_[i]->cpu);
+    }
+  }
+}
+
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    stop_ = true;
+  }
+  idle_.notify_all();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+int Executor::size() const {
+  return workers_.size();
+}
+
+void Executor::push(std::function<void()> task) {
+  // a worker keeps the tasks it submits, for the data they share with the running one
+  size_t target = current_executor == this ? current_worker : next_++ % workers_.size();
+  {
+    std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+    workers_[target]->tasks.push_back(std::move(task));
+  }
+  submitted_++;
+  {
+    // the count changes under the lock, so that a worker about to sleep sees it
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    queued_++;
+  }
+  idle_.notify_one();
+}
+
+bool Executor::pop(size_t self, std::function<void()>& task) {
+  {
+    auto& own = *workers_[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t victim : victims_[self]) {
+    auto& other = *workers_[victim];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      stolen_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Executor::run(size_t self) {
+  current_executor = this;
+  current_worker = self;
+  std::function<void()> task;
+  for (;;) {
+    if (pop(self, task)) {
+      queued_--;
+      started_++;
+      auto start = std::chrono::steady_clock::now();
+      task();
+      task = nullptr;
+      auto busy = std::chrono::steady_clock::now() - start;
+      workers_[self]->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    // a queued task that was not found yet is being taken by another worker, look again
+    idle_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+    if (stop_ && queued_ == 0) {
+      return;
+    }
+  }
+}
+
+ExecutorMetrics Executor::metrics() const {
+  ExecutorMetrics metrics;
+  metrics.workers = workers_.size();
+  metrics.queued = queued_;
+  metrics.submitted = submitted_;
+  metrics.started = started_;
+  metrics.stolen = stolen_;
+  uint64_t busy = 0;
+  for (const auto& worker : workers_) {
+    busy += worker->busy_ns;
+  }
+  double elapsed = double(nowNs() - since_ns_);
+  metrics.utilization = elapsed > 0 ? std::min(1.0, busy / (elapsed * workers_.size())) : 0;
+  return metrics;
+}
+
+void Executor::resetMetrics() {
+  for (auto& worker : workers_) {
+    worker->busy_ns = 0;
+  }
+  submitted_ = 0;
+  started_ = 0;
+  stolen_ = 0;
+  since_ns_ = nowNs();
+}
+
+std::shared_ptr<Executor> Executor::global() {
+  std::lock_guard<std::mutex> lock(global_mutex);
+  if (!global_executor) {
+    global_executor = std::make_shared<Executor>(global_threads, global_pin);
+  }
+  return global_executor;
+}
+
+void Executor::configureGlobal(size_t threads, bool pin) {
+  std::lock_guard<std::mutex> lock(global_mutex);
+  global_threads = threads;
+  global_pin = pin;
+}
+
+};  // namespace common::utils
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace common::utils {
+
+// Queue depth and load of an executor, see Executor::metrics.
+struct ExecutorMetrics {
+  size_t workers = 0;
+  // tasks submitted but not started yet
+  size_t queued = 0;
+  uint64_t submitted = 0;
+  // tasks taken by a worker, running or done
+  uint64_t started = 0;
+  // tasks a worker took from the queue of another worker
+  uint64_t stolen = 0;
+  // share of the time of all workers spent running tasks since construction or the last reset
+  double utilization = 0;
+};
+
+// Work-stealing executor meant to be created once per process and shared by all evaluators,
+// instead of a thread pool per evaluator. Every worker owns a queue: tasks submitted from a
+// worker go to its own queue and run last-in first-out, other tasks are spread round-robin,
+// and an idle worker steals the oldest task of the others, first from the workers on its
+// own NUMA node. With pinning, the workers are spread over the CPUs node by node and each
+// is bound to its CPU (Linux only). The interface is the one of emp's ThreadPool. Tasks must
+// not wait for other tasks of the same executor, nor block on the network.
+class Executor {
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+    int node = 0;
+    int cpu = -1;
+    std::atomic<uint64_t> busy_ns{0};
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // for every worker, the other workers in the order in which it steals from them
+  std::vector<std::vector<size_t>> victims_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+  std::atomic<size_t> queued_{0};
+  std::atomic<size_t> next_{0};
+  std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> started_{0};
+  std::atomic<uint64_t> stolen_{0};
+  // start of the utilization window, in nanoseconds of the steady clock
+  std::atomic<int64_t> since_ns_;
+  bool stop_ = false;
+
+  void push(std::function<void()> task);
+
+  bool pop(size_t self, std::function<void()>& task);
+
+  void run(size_t self);
+
+ public:
+  // threads is the concurrency limit (all hardware threads for 0)
+  explicit Executor(size_t threads = 0, bool pin = false);
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  // runs the tasks still queued, then joins the workers
+  ~Executor();
+
+  template <class F, class... Args>
+  auto enqueue(F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>> {
+    using return_type = std::invoke_result_t<F, Args...>;
+    auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    std::future<return_type> res = task->get_future();
+    push([task]() { (*task)(); });
+    return res;
+  }
+
+  // number of workers
+  int size() const;
+
+  ExecutorMetrics metrics() const;
+
+  // restarts the utilization and the counters of the metrics
+  void resetMetrics();
+
+  // the process-wide executor, created on first use
+  static std::shared_ptr<Executor> global();
+
+  // concurrency limit and pinning of the process-wide executor; only has an effect before its
+  // first use
+  static void configureGlobal(size_t threads, bool pin);
+};
+
+// CPUs of every NUMA node of the machine, a single node with all CPUs when unknown
+std::vector<std::vector<int>> numaNodes();
+
+};  // namespace common::utils
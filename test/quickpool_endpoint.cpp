@@ -7,6 +7,9 @@
 #include "ED_offline_eval.h"
 #include "ED_online_eval.h"
 #include "ED_eval.h"
+#include "Candidate_filter.h"
+#include "ED_session.h"
+#include "pair_check.h"
 #include "sharing.h"
 
 #define START_MATCH_THRESHOLD (Field)50
@@ -26,6 +29,85 @@ struct GlobalFixture {
 
 BOOST_GLOBAL_FIXTURE(GlobalFixture);
 
+// start (x, y) and end (x, y) positions of count parties, with coordinates in [0, max_val]
+std::vector<std::vector<Field>> randomPositions(int count, uint max_val) {
+  static std::mt19937 gen(time(0));
+  std::uniform_int_distribution<uint> distrib(0, max_val);
+  std::vector<std::vector<Field>> positions(count, std::vector<Field>(4));
+  for (auto& pos : positions) {
+    for (auto& coord : pos) {
+      coord = Field(distrib(gen));
+    }
+  }
+  return positions;
+}
+
+// the input of party i, zeros for SP
+std::vector<Field> ownPosition(const std::vector<std::vector<Field>>& positions, int i) {
+  return (i == 0) ? std::vector<Field>(4, 0) : positions[i-1];
+}
+
+// Runs party(i, network) for SP and every rider and driver, each on a thread and a network of
+// its own, and returns their results in the order of the party ids.
+template <class F>
+auto runParties(int rider_count, int driver_count, F party) {
+  using Result = std::invoke_result_t<F, int, std::shared_ptr<io::NetIOMP>>;
+  NTL::ZZ_pContext ZZ_p_ctx;
+  ZZ_p_ctx.save();
+  std::vector<std::future<Result>> parties;
+  for (int i = 0; i <= rider_count + driver_count; ++i) {
+    parties.push_back(std::async(std::launch::async, [&, i]() {
+      ZZ_p_ctx.restore();
+      auto network = std::make_shared<io::NetIOMP>(i, rider_count, driver_count, 10000, nullptr, true);
+      return party(i, network);
+    }));
+  }
+  std::vector<Result> results;
+  for (auto& p : parties) {
+    results.push_back(p.get());
+  }
+  return results;
+}
+
+// matching on a circuit with shared inputs, own holding the features of the party
+std::vector<Field> sharedInputsMatching(ED_eval& ed_eval, int rider_count, int driver_count,
+                                        const std::vector<Field>& own) {
+  std::unordered_map<wire_t, int> input_pid_map;
+  std::unordered_map<wire_t, Field> inputs;
+  setEDSSharedInputs(rider_count, driver_count, own, input_pid_map, inputs);
+  return ed_eval.pair_EDMatching(input_pid_map, inputs);
+}
+
+// squared distances between the start points and between the end points of a rider and a driver
+std::pair<Field, Field> plainDistances(const std::vector<Field>& r, const std::vector<Field>& d) {
+  return {(r[0]-d[0])*(r[0]-d[0]) + (r[1]-d[1])*(r[1]-d[1]),
+          (r[2]-d[2])*(r[2]-d[2]) + (r[3]-d[3])*(r[3]-d[3])};
+}
+
+// Plaintext end-point matching of the candidate pairs (all pairs if none given) in rider-major
+// order, within the default thresholds or within the squared start and end bounds given for
+// each of all pairs.
+std::vector<Field> plainEndpointMatch(const std::vector<std::vector<Field>>& positions, int rider_count,
+                                      int driver_count, const std::vector<std::vector<bool>>& candidates = {},
+                                      const std::vector<Field>& bounds = {}) {
+  std::vector<Field> check;
+  for (int rider=0, k=0; rider<rider_count; rider++) {
+    for (int driver=0; driver<driver_count; driver++, k+=2) {
+      if (!candidates.empty() && !candidates[rider][driver]) {
+        continue;
+      }
+      auto [start, end] = plainDistances(positions[rider], positions[rider_count+driver]);
+      if (bounds.empty()) {
+        check.push_back(Field(start < START_MATCH_THRESHOLD*START_MATCH_THRESHOLD &&
+                              end < END_MATCH_THRESHOLD*END_MATCH_THRESHOLD));
+      } else {
+        check.push_back(Field(start < bounds[k] && end < bounds[k+1]));
+      }
+    }
+  }
+  return check;
+}
+
 BOOST_AUTO_TEST_SUITE(Endpoint_Matching)
 
 // testing the functionality of computing Euclidean distances between 
@@ -288,4 +370,447 @@ BOOST_AUTO_TEST_CASE(all_pair_ED_Matching) {
   BOOST_TEST(output == check);
 }
 
+// testing the matching of the closest pairs from the distance buckets revealed to SP
+BOOST_AUTO_TEST_CASE(bucketed_ED_Matching) {
+  int rider_count = 3;
+  int driver_count = 3;
+  int nP = rider_count + driver_count;
+  size_t buckets = 4;
+
+  // close enough for most pairs to be in range
+  auto positions = randomPositions(nP, 60);
+
+  std::vector<std::vector<bool>> all_pairs(rider_count, std::vector<bool>(driver_count, true));
+  auto level_circ = Circuit<Field>::generateEDSCircuit(rider_count, driver_count).orderGatesByLevel();
+  std::vector<int> assignment;
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    std::unordered_map<wire_t, int> input_pid_map;
+    std::unordered_map<wire_t, Field> inputs;
+    setEDSInputs(rider_count, driver_count, all_pairs, ownPosition(positions, i), input_pid_map, inputs);
+    ED_eval ed_eval(i, rider_count, driver_count, network, level_circ, SECURITY_PARAM, nP);
+    ed_eval.setDistanceBuckets(buckets);
+    auto res = ed_eval.pair_EDMatching(input_pid_map, inputs);
+    if (i == 0) {
+      assignment = ed_eval.getAssignment();
+    }
+    return res;
+  });
+
+  // bucket k of a squared distance d2 in [T^2*k/buckets, T^2*(k+1)/buckets), buckets if out of range
+  auto bucket = [&](Field d2, Field threshold) {
+    int k = 0;
+    while (k < int(buckets) && d2 >= threshold * threshold * (k + 1) / Field(buckets)) {
+      k++;
+    }
+    return k;
+  };
+  std::vector<std::vector<int>> cost(rider_count, std::vector<int>(driver_count, -1));
+  for (int rider=0; rider<rider_count; rider++) {
+    for (int driver=0; driver<driver_count; driver++) {
+      auto [start_sq, end_sq] = plainDistances(positions[rider], positions[rider_count+driver]);
+      int start = bucket(start_sq, START_MATCH_THRESHOLD);
+      int end = bucket(end_sq, END_MATCH_THRESHOLD);
+      if (start < int(buckets) && end < int(buckets)) {
+        cost[rider][driver] = start + end;
+      }
+    }
+  }
+  BOOST_TEST(results[0] == plainEndpointMatch(positions, rider_count, driver_count));
+
+  // the largest matching of least cost, over all assignments of the riders
+  std::pair<int, int> best = {0, 0};
+  std::vector<bool> used(driver_count, false);
+  std::function<void(int, int, int)> search = [&](int rider, int size, int total) {
+    if (rider == rider_count) {
+      if (size > best.first || (size == best.first && total < best.second)) {
+        best = {size, total};
+      }
+      return;
+    }
+    search(rider + 1, size, total);
+    for (int driver = 0; driver < driver_count; driver++) {
+      if (!used[driver] && cost[rider][driver] >= 0) {
+        used[driver] = true;
+        search(rider + 1, size + 1, total + cost[rider][driver]);
+        used[driver] = false;
+      }
+    }
+  };
+  search(0, 0, 0);
+
+  BOOST_TEST(assignment.size() == rider_count);
+  int size = 0, total = 0;
+  std::fill(used.begin(), used.end(), false);
+  for (int rider=0; rider<rider_count; rider++) {
+    int driver = assignment[rider];
+    if (driver >= 0) {
+      BOOST_TEST(cost[rider][driver] >= 0);
+      BOOST_TEST(!used[driver]);
+      used[driver] = true;
+      size++;
+      total += cost[rider][driver];
+    }
+  }
+  BOOST_TEST(size == best.first);
+  BOOST_TEST(total == best.second);
+}
+
+// testing the candidate pre-filter followed by end-point based matching on the candidate pairs only
+BOOST_AUTO_TEST_CASE(candidate_ED_Matching) {
+  int rider_count = 3;
+  int driver_count = 3;
+  int nP = rider_count + driver_count;
+  Field cell_size = START_MATCH_THRESHOLD;
+
+  // start (x, y) and end (x, y) positions of every rider and driver
+  std::vector<std::vector<Field>> positions = {
+    {0, 0, 0, 0}, {500, 500, 900, 900}, {-120, 40, 300, -300},
+    {30, 10, 20, 35}, {520, 470, 2000, 2000}, {-80, 60, 320, -270}};
+
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    Candidate_filter filter(i, rider_count, driver_count, network, cell_size);
+    if (i != 0) {
+      auto& pos = positions[i-1];
+      filter.setInputs(pos[0], pos[1], pos[2], pos[3]);
+    }
+    auto candidates = filter.processCandidates();
+
+    auto circ = Circuit<Field>::generateEDSCircuit(rider_count, driver_count, candidates);
+    std::unordered_map<wire_t, int> input_pid_map;
+    std::unordered_map<wire_t, Field> inputs;
+    for (int rider=0, j=0; rider<rider_count; rider++) {
+      int rider_id = rider+1;
+      for (int driver=0; driver<driver_count; driver++) {
+        if (!candidates[rider][driver]) {
+          continue;
+        }
+        int driver_id = driver+rider_count+1;
+        for(int k = 0; k < 2; ++k) {
+          input_pid_map[j] = rider_id;
+          inputs[j++] = positions[rider_id-1][k];
+          input_pid_map[j] = rider_id;
+          inputs[j++] = positions[rider_id-1][2+k];
+          input_pid_map[j] = driver_id;
+          inputs[j++] = positions[driver_id-1][k];
+          input_pid_map[j] = driver_id;
+          inputs[j++] = positions[driver_id-1][2+k];
+        }
+        j+= 6; // to skip subtraction gates and dotproduct gates in the circuit
+      }
+    }
+    ED_eval ed_eval(i, rider_count, driver_count, network, circ.orderGatesByLevel(), SECURITY_PARAM, nP);
+    auto res = ed_eval.pair_EDMatching(input_pid_map, inputs);
+    return std::make_pair(candidates, res);
+  });
+
+  auto& candidates = results[0].first;
+  for (auto& res : results) {
+    BOOST_TEST(res.first == candidates);
+  }
+
+  // no pair within the thresholds is pruned, while far away pairs are
+  auto in_range = plainEndpointMatch(positions, rider_count, driver_count);
+  for (int rider=0; rider<rider_count; rider++) {
+    for (int driver=0; driver<driver_count; driver++) {
+      if (in_range[rider*driver_count + driver]) {
+        BOOST_TEST(candidates[rider][driver]);
+      }
+    }
+  }
+  BOOST_TEST(!candidates[0][1]);
+  BOOST_TEST(!candidates[1][1]);
+  BOOST_TEST(results[0].second == plainEndpointMatch(positions, rider_count, driver_count, candidates));
+}
+
+// testing incremental end-point based matching with riders and drivers joining and leaving
+BOOST_AUTO_TEST_CASE(incremental_ED_Matching) {
+  int rider_count = 2;
+  int driver_count = 3;
+  int nP = rider_count + driver_count;
+
+  // start (x, y) and end (x, y) positions of every rider and driver
+  std::vector<std::vector<Field>> positions = {
+    {0, 0, 100, 100}, {500, 500, 600, 600},
+    {10, 10, 90, 110}, {480, 510, 590, 620}, {5, 0, 95, 95}};
+
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    ED_session session(i, rider_count, driver_count, network, SECURITY_PARAM, nP);
+    if (i != 0) {
+      auto& pos = positions[i-1];
+      session.setInputs(pos[0], pos[1], pos[2], pos[3]);
+    }
+    session.addDriver(3);
+    session.addRider(1);
+    session.addDriver(4);
+    session.addRider(2);
+    session.removeDriver(3);
+    session.addDriver(5);
+    return session.getMatches();
+  });
+
+  std::vector<std::vector<bool>> check = {{false, false, true}, {false, true, false}};
+  BOOST_TEST(results[0] == check);
+
+  // the circuit of an event only has the input wires and gates of its row or column
+  auto block = Circuit<Field>::generateBlockCircuit(1000, {7}, {1, 2},
+                                                    MatchingSpec<Field>::endpoints(Field(1), Field(1)));
+  BOOST_TEST(block.orderGatesByLevel().num_gates == 3 * 4 + 2 * 6);
+}
+
+// testing that tiled end-point based matching gives the same outputs as the untiled one
+BOOST_AUTO_TEST_CASE(tiled_ED_Matching) {
+  int rider_count = 3;
+  int driver_count = 4;
+  int nP = rider_count + driver_count;
+  auto positions = randomPositions(nP, 100);
+
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    ED_eval ed_eval(i, rider_count, driver_count, network, LevelOrderedCircuit(), SECURITY_PARAM, nP);
+    return ed_eval.pair_EDMatchingTiled(ownPosition(positions, i), 2, 3);
+  });
+
+  BOOST_TEST(results[0] == plainEndpointMatch(positions, rider_count, driver_count));
+}
+
+BOOST_AUTO_TEST_CASE(funshade_ED_Matching) {
+  int rider_count = 3;
+  int driver_count = 4;
+  int nP = rider_count + driver_count;
+  auto positions = randomPositions(nP, 100);
+
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    ED_eval ed_eval(i, rider_count, driver_count, network, LevelOrderedCircuit(), SECURITY_PARAM, 2);
+    return ed_eval.pair_EDMatchingFunshade(ownPosition(positions, i));
+  });
+
+  BOOST_TEST(results[0] == plainEndpointMatch(positions, rider_count, driver_count));
+}
+
+// testing end-point based matching with the positions input once per party and shared by its pairs
+BOOST_AUTO_TEST_CASE(shared_inputs_ED_Matching) {
+  int rider_count = 3;
+  int driver_count = 3;
+  int nP = rider_count + driver_count;
+  auto positions = randomPositions(nP, 60);
+
+  // driver 2 is a candidate of rider 1 only and rider 3 has no candidates
+  std::vector<std::vector<bool>> candidates = {{true, true, true}, {true, true, false}, {false, false, false}};
+  auto circ = Circuit<Field>::generateEDSSharedCircuit(rider_count, driver_count, candidates);
+  auto level_circ = circ.orderGatesByLevel();
+  BOOST_TEST(level_circ.count[GateType::kInp] == 4 * nP);
+  BOOST_TEST(level_circ.input_peers.at(0) == std::vector<int>({4, 5, 6}));
+  BOOST_TEST(level_circ.input_peers.at(4 * 5) == std::vector<int>({1}));
+  BOOST_TEST(level_circ.input_peers.at(4 * 2).empty());
+
+  // the plaintext circuit on the positions of all parties gives the distances of the candidates
+  std::unordered_map<wire_t, Field> all_inputs;
+  for (int party=0; party<nP; party++) {
+    for (int k=0; k<4; k++) {
+      all_inputs[4 * party + k] = positions[party][k];
+    }
+  }
+  auto insecure_outputs = circ.evaluate(all_inputs);
+  for (int rider=0, k=0; rider<rider_count; rider++) {
+    for (int driver=0; driver<driver_count; driver++) {
+      if (candidates[rider][driver]) {
+        auto [start, end] = plainDistances(positions[rider], positions[rider_count+driver]);
+        BOOST_TEST(insecure_outputs[k++] == start);
+        BOOST_TEST(insecure_outputs[k++] == end);
+      }
+    }
+  }
+
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    ED_eval ed_eval(i, rider_count, driver_count, network, level_circ, SECURITY_PARAM, nP);
+    return sharedInputsMatching(ed_eval, rider_count, driver_count, ownPosition(positions, i));
+  });
+
+  BOOST_TEST(results[0] == plainEndpointMatch(positions, rider_count, driver_count, candidates));
+}
+
+// the features, the bounds and the coordinates must fit the domain of the comparisons
+BOOST_AUTO_TEST_CASE(spec_domain) {
+  auto spec = MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD);
+  BOOST_CHECK_NO_THROW(checkMatchingSpec(spec, {2500, 100, 0, 2500}));
+  BOOST_CHECK_THROW(checkMatchingSpec(spec, {2500}), std::invalid_argument);
+  BOOST_CHECK_THROW(checkMatchingSpec(spec, {2500, -(Field(1) << 23)}), std::invalid_argument);
+  BOOST_CHECK_NO_THROW(checkCoordinates(spec, {0, 0, 2047, 2047}));
+  BOOST_CHECK_THROW(checkCoordinates(spec, {0, 0, 2048, 0}), std::invalid_argument);
+  BOOST_CHECK_THROW(checkCoordinates(spec, {-1, 0, 0, 0}), std::invalid_argument);
+  BOOST_CHECK_THROW(checkCoordinates(spec, {0, 0}), std::invalid_argument);
+
+  // squared distances of coordinates in [0, 4096) need 26 bits
+  spec.features[0].range = 4096;
+  BOOST_CHECK_THROW(checkMatchingSpec(spec), std::invalid_argument);
+
+  // a large weight needs a smaller range, a feature needs coordinates and a weight for each
+  MatchingSpec<Field> weighted{{{2, {1000, 1}, 2500}}};
+  BOOST_CHECK_THROW(checkMatchingSpec(weighted), std::invalid_argument);
+  weighted.features[0].range = 64;
+  BOOST_CHECK_NO_THROW(checkMatchingSpec(weighted));
+  BOOST_CHECK_THROW(checkMatchingSpec({{{0, {}, 1, false}}}), std::invalid_argument);
+  BOOST_CHECK_THROW(checkMatchingSpec({{{2, {1}, 1}}}), std::invalid_argument);
+  BOOST_CHECK_THROW(Circuit<Field>::generatePairCircuit(1, 2, {{{0, {}, 1, false}}}), std::invalid_argument);
+
+  // the funshade mode computes in 32 bits
+  BOOST_CHECK_NO_THROW(checkFunshadeInputs({0, 0, 32767, 32767}, {2500, (Field(1) << 31) - 1}));
+  BOOST_CHECK_THROW(checkFunshadeInputs({0, 32768, 0, 0}), std::invalid_argument);
+  BOOST_CHECK_THROW(checkFunshadeInputs({0, 0, -1, 0}), std::invalid_argument);
+  BOOST_CHECK_THROW(checkFunshadeInputs({0, 0, 0, 0}, {Field(1) << 31}), std::invalid_argument);
+  BOOST_CHECK_THROW(checkFunshadeInputs({0, 0, 0, 0}, {-1}), std::invalid_argument);
+}
+
+// testing matching on features other than the end points: weighted start points, pickup times and seats
+BOOST_AUTO_TEST_CASE(feature_spec_Matching) {
+  int rider_count = 3;
+  int driver_count = 4;
+  int nP = rider_count + driver_count;
+
+  // the start x counts 4 times the start y, the pickup times differ by less than 10 and the
+  // driver has at least as many free seats as the rider needs
+  MatchingSpec<Field> spec{{{2, {4, 1}, 2500, true, 41}, {1, {}, 100, true, 21}, {1, {}, 1, false, 5}}};
+  BOOST_TEST(spec.inputLength() == 4);
+
+  std::mt19937 gen(time(0));
+  std::uniform_int_distribution<uint> coord(0, 40), minutes(0, 20), seats(1, 4);
+  std::vector<std::vector<Field>> features(nP);
+  for (auto& f : features) {
+    f = {Field(coord(gen)), Field(coord(gen)), Field(minutes(gen)), Field(seats(gen))};
+  }
+
+  std::vector<std::vector<bool>> all_pairs(rider_count, std::vector<bool>(driver_count, true));
+  auto level_circ = Circuit<Field>::generateMatchingCircuit(rider_count, driver_count, all_pairs, spec).orderGatesByLevel();
+  BOOST_TEST(level_circ.outputs.size() == 3 * rider_count * driver_count);
+
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    ED_eval ed_eval(i, rider_count, driver_count, network, level_circ, SECURITY_PARAM, nP);
+    ed_eval.setMatchingSpec(spec);
+    return sharedInputsMatching(ed_eval, rider_count, driver_count, ownPosition(features, i));
+  });
+
+  std::vector<Field> check;
+  for (int rider=0; rider<rider_count; rider++) {
+    for (int driver=0; driver<driver_count; driver++) {
+      auto& r = features[rider];
+      auto& d = features[rider_count+driver];
+      bool start = 4*(r[0]-d[0])*(r[0]-d[0]) + (r[1]-d[1])*(r[1]-d[1]) < 2500;
+      bool pickup = (r[2]-d[2])*(r[2]-d[2]) < 100;
+      bool seat = r[3] <= d[3];
+      check.push_back(Field(start && pickup && seat));
+    }
+  }
+
+  BOOST_TEST(results[0] == check);
+}
+
+// testing per-pair bounds folded into the DCF keys, known to SP only
+BOOST_AUTO_TEST_CASE(pair_bounds_ED_Matching) {
+  int rider_count = 3;
+  int driver_count = 3;
+  int nP = rider_count + driver_count;
+  auto positions = randomPositions(nP, 60);
+
+  // squared start and end radii of every pair
+  std::mt19937 gen(time(0));
+  std::uniform_int_distribution<uint> radius(10, 60);
+  std::vector<Field> bounds(2 * rider_count * driver_count);
+  for (auto& b : bounds) {
+    Field r = Field(radius(gen));
+    b = r * r;
+  }
+
+  std::vector<std::vector<bool>> all_pairs(rider_count, std::vector<bool>(driver_count, true));
+  auto level_circ = Circuit<Field>::generateEDSSharedCircuit(rider_count, driver_count, all_pairs).orderGatesByLevel();
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    ED_eval ed_eval(i, rider_count, driver_count, network, level_circ, SECURITY_PARAM, nP);
+    if (i == 0) {
+      ed_eval.setPairBounds(bounds);
+    }
+    return sharedInputsMatching(ed_eval, rider_count, driver_count, ownPosition(positions, i));
+  });
+
+  BOOST_TEST(results[0] == plainEndpointMatch(positions, rider_count, driver_count, {}, bounds));
+}
+
+// testing the matching SP grows while the result shares of the parties arrive, with a driver
+// that has no candidate pairs and so sends no shares
+BOOST_AUTO_TEST_CASE(streamed_ED_Matching) {
+  int rider_count = 3;
+  int driver_count = 4;
+  int nP = rider_count + driver_count;
+  auto positions = randomPositions(nP, 60);
+
+  std::vector<std::vector<bool>> candidates(rider_count, std::vector<bool>(driver_count, true));
+  for (auto& row : candidates) {
+    row[driver_count-1] = false;
+  }
+  auto level_circ = Circuit<Field>::generateEDSSharedCircuit(rider_count, driver_count, candidates).orderGatesByLevel();
+  std::vector<int> assignment;
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    ED_eval ed_eval(i, rider_count, driver_count, network, level_circ, SECURITY_PARAM, nP);
+    auto res = sharedInputsMatching(ed_eval, rider_count, driver_count, ownPosition(positions, i));
+    if (i == 0) {
+      assignment = ed_eval.getAssignment();
+    }
+    return res;
+  });
+
+  BOOST_TEST(results[0] == plainEndpointMatch(positions, rider_count, driver_count, candidates));
+
+  auto all_pairs = plainEndpointMatch(positions, rider_count, driver_count);
+  std::vector<std::vector<bool>> in_range(rider_count, std::vector<bool>(driver_count));
+  for (int rider=0; rider<rider_count; rider++) {
+    for (int driver=0; driver<driver_count; driver++) {
+      in_range[rider][driver] = candidates[rider][driver] && all_pairs[rider*driver_count + driver];
+    }
+  }
+  BOOST_TEST(int(matchingSize(assignment)) == maxBPM(in_range));
+  for (int rider=0; rider<rider_count; rider++) {
+    if (assignment[rider] >= 0) {
+      BOOST_TEST(in_range[rider][assignment[rider]]);
+    }
+  }
+}
+
+// testing repeated re-checks of one pair on prepared material, in two batches
+BOOST_AUTO_TEST_CASE(pair_check_ED_Matching) {
+  int rider_count = 2;
+  int driver_count = 2;
+  int rider_id = 2;
+  int driver_id = 3;
+  int checks = 4;
+
+  // the positions of the rider and of the driver in every check
+  auto rider_pos = randomPositions(checks, 60);
+  auto driver_pos = randomPositions(checks, 60);
+
+  auto results = runParties(rider_count, driver_count, [&](int i, std::shared_ptr<io::NetIOMP> network) {
+    std::vector<Field> res;
+    if (i != 0 && i != rider_id && i != driver_id) {
+      return res;
+    }
+    auto spec = MatchingSpec<Field>::endpoints(START_MATCH_THRESHOLD, END_MATCH_THRESHOLD);
+    PairCheck pair(i, rider_count, driver_count, network, rider_id, driver_id, spec, SECURITY_PARAM,
+                   std::make_shared<Executor>(2));
+    pair.prepare(checks - 1);
+    for (int c = 0; c < checks; c++) {
+      if (c == checks - 1) {
+        // a check only runs on prepared material
+        BOOST_CHECK_THROW(pair.check(i == rider_id ? rider_pos[c] : driver_pos[c]), std::runtime_error);
+        pair.prepare(1);
+      }
+      res.push_back(pair.check(i == rider_id ? rider_pos[c] : driver_pos[c]));
+    }
+    BOOST_TEST(pair.prepared() == 0);
+    return res;
+  });
+
+  std::vector<Field> check;
+  for (int c = 0; c < checks; c++) {
+    check.push_back(plainEndpointMatch({rider_pos[c], driver_pos[c]}, 1, 1)[0]);
+  }
+
+  BOOST_TEST(results[0] == check);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
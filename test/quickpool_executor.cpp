@@ -0,0 +1,88 @@
+#define BOOST_TEST_MODULE Quickpool_executor
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <atomic>
+#include <mutex>
+
+#include "executor.h"
+
+using namespace common::utils;
+
+BOOST_AUTO_TEST_SUITE(executor)
+
+BOOST_AUTO_TEST_CASE(results) {
+  Executor tpool(3);
+  BOOST_TEST(tpool.size() == 3);
+  std::vector<std::future<int>> res;
+  for (int i = 0; i < 100; ++i) {
+    res.push_back(tpool.enqueue([](int x) { return x * x; }, i));
+  }
+  for (int i = 0; i < 100; ++i) {
+    BOOST_TEST(res[i].get() == i * i);
+  }
+  auto metrics = tpool.metrics();
+  BOOST_TEST(metrics.workers == 3);
+  BOOST_TEST(metrics.submitted == 100);
+  BOOST_TEST(metrics.started == 100);
+  BOOST_TEST(metrics.queued == 0);
+  BOOST_TEST(metrics.utilization >= 0);
+  BOOST_TEST(metrics.utilization <= 1);
+
+  tpool.resetMetrics();
+  BOOST_TEST(tpool.metrics().started == 0);
+}
+
+BOOST_AUTO_TEST_CASE(exceptions) {
+  Executor tpool(2);
+  auto res = tpool.enqueue([]() -> int { throw std::runtime_error("failed task"); });
+  BOOST_CHECK_THROW(res.get(), std::runtime_error);
+  BOOST_TEST(tpool.enqueue([]() { return 1; }).get() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(stealing) {
+  // a single task spawns all the others on the queue of its worker, the idle ones steal them
+  Executor tpool(4);
+  std::atomic<int> sum{0};
+  std::vector<std::future<void>> res;
+  std::mutex res_lock;
+  tpool.enqueue([&]() {
+    for (int i = 0; i < 1000; ++i) {
+      auto f = tpool.enqueue([&sum, i]() { sum += i; });
+      std::lock_guard<std::mutex> guard(res_lock);
+      res.push_back(std::move(f));
+    }
+  }).get();
+  for (auto& r : res) {
+    r.get();
+  }
+  BOOST_TEST(sum == 999 * 1000 / 2);
+  BOOST_TEST(tpool.metrics().started == 1001);
+}
+
+BOOST_AUTO_TEST_CASE(drained_on_destruction) {
+  std::atomic<int> done{0};
+  {
+    Executor tpool(2, true);
+    for (int i = 0; i < 50; ++i) {
+      tpool.enqueue([&done]() { done++; });
+    }
+  }
+  BOOST_TEST(done == 50);
+}
+
+BOOST_AUTO_TEST_CASE(numa_nodes) {
+  auto nodes = numaNodes();
+  BOOST_TEST(!nodes.empty());
+  for (const auto& cpus : nodes) {
+    BOOST_TEST(!cpus.empty());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(global) {
+  auto tpool = Executor::global();
+  BOOST_TEST(tpool == Executor::global());
+  BOOST_TEST(tpool->size() >= 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,196 @@
+#define BOOST_TEST_MODULE Quickpool_matching
+
+#include <boost/test/data/monomorphic.hpp>
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include <algorithm>
+#include <random>
+
+#include "ED_eval.h"
+#include "matching.h"
+
+using namespace quickpool;
+namespace bdata = boost::unit_test::data;
+
+// size of a maximum matching with Kuhn's algorithm, as a reference
+int kuhnMatching(const std::vector<std::vector<bool>>& graph) {
+  size_t cols = graph.empty() ? 0 : graph[0].size();
+  std::vector<int> match(cols, -1);
+  std::vector<bool> seen;
+  std::function<bool(int)> augment = [&](int u) {
+    for (size_t v = 0; v < cols; ++v) {
+      if (graph[u][v] && !seen[v]) {
+        seen[v] = true;
+        if (match[v] < 0 || augment(match[v])) {
+          match[v] = u;
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+  int size = 0;
+  for (size_t u = 0; u < graph.size(); ++u) {
+    seen.assign(cols, false);
+    size += augment(u);
+  }
+  return size;
+}
+
+std::vector<std::vector<bool>> randomGraph(size_t rows, size_t cols, double density, int seed) {
+  std::mt19937 gen(seed);
+  std::bernoulli_distribution edge(density);
+  std::vector<std::vector<bool>> graph(rows, std::vector<bool>(cols));
+  for (auto& row : graph) {
+    for (size_t v = 0; v < cols; ++v) {
+      row[v] = edge(gen);
+    }
+  }
+  return graph;
+}
+
+// every matched rider has an edge to its driver and no driver is used twice
+void checkAssignment(const std::vector<std::vector<bool>>& graph, const std::vector<int>& assignment) {
+  BOOST_TEST(assignment.size() == graph.size());
+  std::vector<bool> used(graph.empty() ? 0 : graph[0].size(), false);
+  for (size_t u = 0; u < assignment.size(); ++u) {
+    if (assignment[u] >= 0) {
+      BOOST_TEST(graph[u][assignment[u]]);
+      BOOST_TEST(!used[assignment[u]]);
+      used[assignment[u]] = true;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE(matching)
+
+BOOST_AUTO_TEST_CASE(bit_matrix) {
+  BitMatrix adj(3, 130);
+  BOOST_TEST(adj.words() == 3);
+  adj.set(1, 129);
+  adj.set(2, 64);
+  adj.set(2, 64, false);
+  BOOST_TEST(adj.get(1, 129));
+  BOOST_TEST(!adj.get(2, 64));
+  BOOST_TEST(adj.row(1)[2] == 2);
+
+  BitMatrix dense({{true, false}, {false, true}});
+  BOOST_TEST(dense.rows() == 2);
+  BOOST_TEST(dense.cols() == 2);
+  BOOST_TEST(dense.get(0, 0));
+  BOOST_TEST(!dense.get(0, 1));
+}
+
+BOOST_AUTO_TEST_CASE(augmenting_path) {
+  // the greedy matching takes (0, 0) and (1, 1), only augmenting frees driver 2 for rider 2
+  std::vector<std::vector<bool>> graph = {{true, true, false},
+                                          {false, true, true},
+                                          {true, false, false}};
+  auto assignment = hopcroftKarp(BitMatrix(graph));
+  checkAssignment(graph, assignment);
+  BOOST_TEST(matchingSize(assignment) == 3);
+  BOOST_TEST(maxBPM(graph) == 3);
+}
+
+BOOST_DATA_TEST_CASE(random_graphs,
+                     bdata::make({1, 7, 64, 100}) * bdata::make({1, 63, 65, 150}) * bdata::make({0.02, 0.1, 0.5}),
+                     rows, cols, density) {
+  auto graph = randomGraph(rows, cols, density, rows * 1000 + cols);
+  auto assignment = hopcroftKarp(BitMatrix(graph));
+  checkAssignment(graph, assignment);
+  BOOST_TEST(matchingSize(assignment) == kuhnMatching(graph));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_layers) {
+  // sparse enough for long augmenting paths, large enough for the BFS to be split
+  auto graph = randomGraph(2000, 2000, 0.001, 42);
+  Executor tpool(4);
+  auto sequential = hopcroftKarp(BitMatrix(graph));
+  auto parallel = hopcroftKarp(BitMatrix(graph), &tpool);
+  checkAssignment(graph, parallel);
+  BOOST_TEST(matchingSize(parallel) == matchingSize(sequential));
+  BOOST_TEST(matchingSize(parallel) == kuhnMatching(graph));
+}
+
+BOOST_DATA_TEST_CASE(warm_start, bdata::make({1, 64, 150}) * bdata::make({0.02, 0.1, 0.5}), size, density) {
+  // a greedy matching over the edges in a shuffled order of arrival, then completed
+  auto graph = randomGraph(size, size, density, size * 10 + int(density * 100));
+  std::vector<std::pair<int, int>> arrivals;
+  for (int u = 0; u < size; ++u) {
+    for (int v = 0; v < size; ++v) {
+      if (graph[u][v]) {
+        arrivals.push_back({u, v});
+      }
+    }
+  }
+  std::shuffle(arrivals.begin(), arrivals.end(), std::mt19937(size));
+  std::vector<int> initial(size, -1);
+  std::vector<bool> taken(size, false);
+  for (auto [u, v] : arrivals) {
+    if (initial[u] < 0 && !taken[v]) {
+      initial[u] = v;
+      taken[v] = true;
+    }
+  }
+  auto assignment = hopcroftKarp(BitMatrix(graph), initial);
+  checkAssignment(graph, assignment);
+  BOOST_TEST(matchingSize(assignment) == kuhnMatching(graph));
+  // a matched rider stays matched
+  for (int u = 0; u < size; ++u) {
+    if (initial[u] >= 0) {
+      BOOST_TEST(assignment[u] >= 0);
+    }
+  }
+}
+
+BOOST_DATA_TEST_CASE(min_cost_assignment, bdata::make({1, 2, 3, 4, 5, 6}) * bdata::make({0.2, 0.5, 0.9}), n,
+                     density) {
+  // the largest matching of least cost with brute force, over all assignments of the riders
+  for (int seed = 0; seed < 20; ++seed) {
+    std::mt19937 gen(seed * 100 + n);
+    std::uniform_int_distribution<int> cost_distrib(0, 6);
+    auto graph = randomGraph(n, n + seed % 3, density, seed * 100 + n);
+    std::vector<CostEdge> edges;
+    std::vector<std::vector<int>> cost(n, std::vector<int>(graph[0].size(), -1));
+    for (int u = 0; u < n; ++u) {
+      for (size_t v = 0; v < graph[u].size(); ++v) {
+        if (graph[u][v]) {
+          cost[u][v] = cost_distrib(gen);
+          edges.push_back({u, int(v), cost[u][v]});
+        }
+      }
+    }
+    std::pair<int, int> best = {0, 0};
+    std::vector<bool> used(graph[0].size(), false);
+    std::function<void(int, int, int)> search = [&](int u, int size, int total) {
+      if (u == n) {
+        if (size > best.first || (size == best.first && total < best.second)) {
+          best = {size, total};
+        }
+        return;
+      }
+      search(u + 1, size, total);
+      for (size_t v = 0; v < used.size(); ++v) {
+        if (!used[v] && cost[u][v] >= 0) {
+          used[v] = true;
+          search(u + 1, size + 1, total + cost[u][v]);
+          used[v] = false;
+        }
+      }
+    };
+    search(0, 0, 0);
+
+    Executor tpool(2);
+    auto assignment = minCostAssignment(n, graph[0].size(), edges, seed % 2 ? &tpool : nullptr);
+    checkAssignment(graph, assignment);
+    int total = 0;
+    for (int u = 0; u < n; ++u) {
+      total += assignment[u] >= 0 ? cost[u][assignment[u]] : 0;
+    }
+    BOOST_TEST(int(matchingSize(assignment)) == best.first);
+    BOOST_TEST(total == best.second);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
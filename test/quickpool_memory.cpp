@@ -0,0 +1,133 @@
+#define BOOST_TEST_MODULE Quickpool_memory
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+#include <random>
+
+#include "ED_eval.h"
+
+using namespace quickpool;
+using namespace common::utils;
+constexpr int SECURITY_PARAM = 128;
+
+// heap in use and its peak in this process, counted by the global allocation functions below
+static std::atomic<int64_t> heap_live{0};
+static std::atomic<int64_t> heap_peak{0};
+
+static void* trackedAlloc(size_t n) {
+  void* p = std::malloc(n ? n : 1);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  int64_t live = heap_live += malloc_usable_size(p);
+  int64_t peak = heap_peak;
+  while (live > peak && !heap_peak.compare_exchange_weak(peak, live)) {
+  }
+  return p;
+}
+
+static void trackedFree(void* p) {
+  if (p != nullptr) {
+    heap_live -= malloc_usable_size(p);
+    std::free(p);
+  }
+}
+
+void* operator new(size_t n) { return trackedAlloc(n); }
+void* operator new[](size_t n) { return trackedAlloc(n); }
+void operator delete(void* p) noexcept { trackedFree(p); }
+void operator delete[](void* p) noexcept { trackedFree(p); }
+void operator delete(void* p, size_t) noexcept { trackedFree(p); }
+void operator delete[](void* p, size_t) noexcept { trackedFree(p); }
+
+struct GlobalFixture {
+  GlobalFixture() {
+    NTL::ZZ_p::init(NTL::conv<NTL::ZZ>("17816577890427308801"));
+  }
+};
+
+BOOST_GLOBAL_FIXTURE(GlobalFixture);
+
+// Runs the tiled matching with every party in a process of its own and returns the peak heap
+// every party needed on top of what it held once connected, SP first.
+std::vector<int64_t> tiledPeaks(int rider_count, int driver_count, size_t side, int port) {
+  int nP = rider_count + driver_count;
+  std::mt19937 gen(side);
+  std::uniform_int_distribution<uint> distrib(0, 100);
+  std::vector<std::vector<Field>> positions(nP, std::vector<Field>(4));
+  for (auto& pos : positions) {
+    for (auto& coord : pos) {
+      coord = Field(distrib(gen));
+    }
+  }
+
+  std::vector<int> pipes(nP + 1);
+  std::vector<pid_t> children(nP + 1);
+  for (int i = 0; i <= nP; ++i) {
+    int fd[2];
+    BOOST_REQUIRE(pipe(fd) == 0);
+    children[i] = fork();
+    BOOST_REQUIRE(children[i] >= 0);
+    if (children[i] == 0) {
+      close(fd[0]);
+      auto network = std::make_shared<io::NetIOMP>(i, rider_count, driver_count, port, nullptr, true);
+      auto tpool = std::make_shared<Executor>(1);
+      std::vector<Field> position = (i == 0) ? std::vector<Field>(4, 0) : positions[i - 1];
+      int64_t baseline = heap_live;
+      heap_peak = baseline;
+      {
+        ED_eval ed_eval(i, rider_count, driver_count, network, LevelOrderedCircuit(), SECURITY_PARAM, tpool);
+        ed_eval.pair_EDMatchingTiled(position, side, side);
+      }
+      int64_t peak = heap_peak - baseline;
+      ssize_t written = write(fd[1], &peak, sizeof(peak));
+      _exit(written == sizeof(peak) ? 0 : 1);
+    }
+    close(fd[1]);
+    pipes[i] = fd[0];
+  }
+
+  std::vector<int64_t> peaks(nP + 1, -1);
+  for (int i = 0; i <= nP; ++i) {
+    BOOST_TEST(read(pipes[i], &peaks[i], sizeof(int64_t)) == ssize_t(sizeof(int64_t)));
+    close(pipes[i]);
+    int status = 0;
+    waitpid(children[i], &status, 0);
+    BOOST_TEST(WIFEXITED(status));
+    BOOST_TEST(WEXITSTATUS(status) == 0);
+  }
+  return peaks;
+}
+
+BOOST_AUTO_TEST_SUITE(memory)
+
+BOOST_AUTO_TEST_CASE(tile_budget) {
+  int rider_count = 12;
+  int driver_count = 12;
+
+  // every party stays within the budget the tile side is derived from
+  size_t budget = 0;
+  for (size_t side : {2, 4}) {
+    budget = ED_eval::tileFixedBytes(rider_count, driver_count) + side * side * TILE_BYTES_PER_PAIR;
+    BOOST_TEST(ED_eval::tileSide(budget, rider_count, driver_count) == side);
+    auto peaks = tiledPeaks(rider_count, driver_count, side, 12000 + 100 * side);
+    for (size_t i = 0; i < peaks.size(); ++i) {
+      BOOST_TEST_CONTEXT("side " << side << ", party " << i) {
+        BOOST_TEST(peaks[i] > 0);
+        BOOST_TEST(size_t(peaks[i]) <= budget);
+      }
+    }
+  }
+
+  // the budget binds: SP needs more than that for all pairs at once
+  auto peaks = tiledPeaks(rider_count, driver_count, rider_count, 13000);
+  BOOST_TEST(size_t(peaks[0]) > budget);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
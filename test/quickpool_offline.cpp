@@ -5,6 +5,7 @@
 #include <boost/test/included/unit_test.hpp>
 
 #include "ED_offline_eval.h"
+#include "fss.h"
 
 using namespace quickpool;
 using namespace common::utils;
@@ -140,4 +141,58 @@ BOOST_AUTO_TEST_CASE(depth_2_circuit) {
 	} 
 	
 }
+BOOST_AUTO_TEST_CASE(dcf_keys) {
+	NTL::ZZ_pContext ZZ_p_ctx;
+	ZZ_p_ctx.save();
+  int rider_count = 1;
+  int driver_count = 1;
+  int nP = rider_count + driver_count;
+  int rider_index = 1;
+  int driver_index = 2;
+	Circuit<Field> circ;
+	std::unordered_map<wire_t, int> input_pid_map;
+
+	auto w_a = circ.newInputWire(rider_index, driver_index);
+	auto w_b = circ.newInputWire(rider_index, driver_index);
+	input_pid_map[w_a] = rider_index;
+	input_pid_map[w_b] = driver_index;
+	auto w_sub = circ.addGate(GateType::kSub, w_a, w_b, rider_index, driver_index);
+	auto w_mul = circ.addGate(GateType::kMul, w_a, w_b, rider_index, driver_index);
+	circ.setAsOutput(w_sub, rider_index, driver_index);
+	circ.setAsOutput(w_mul, rider_index, driver_index);
+	auto level_circ = circ.orderGatesByLevel();
+	std::vector<std::future<PreprocCircuit<Field>>> parties;
+	parties.reserve(nP+1);
+	for (int i = 0; i <= nP; ++i) {
+		parties.push_back(std::async(std::launch::async, [&, i, input_pid_map]() {
+			ZZ_p_ctx.restore();
+      auto network = std::make_shared<io::NetIOMP>(i, rider_count, driver_count, 10000, nullptr, true);
+      OfflineEvaluator eval(i, rider_count, driver_count, std::move(network), level_circ, SECURITY_PARAM, nP);
+			eval.setWireMasks(input_pid_map);
+			eval.setDCFKeys();
+			return eval.getPreproc();
+		}));
+	}
+	std::vector<PreprocCircuit<Field>> v_preproc;
+	v_preproc.reserve(parties.size());
+	for (auto& f : parties) {
+		v_preproc.push_back(f.get());
+	}
+
+	BOOST_TEST(v_preproc[0].dcf_keys.empty());
+	BOOST_TEST(v_preproc[rider_index].dcf_keys.size() == level_circ.outputs.size() * EDBitComparison::KEY_LEN_);
+	BOOST_TEST(v_preproc[driver_index].dcf_keys.size() == level_circ.outputs.size() * EDBitComparison::KEY_LEN_);
+	// the keys of rider and driver compare the masked value against the mask of the
+	// output wire, the least significant bits of their outputs are XOR shares of the result
+	std::mt19937 gen(200);
+	std::uniform_int_distribution<int64_t> distrib(-(1 << (ED_DCF_DOMAIN_BITS - 1)), (1 << (ED_DCF_DOMAIN_BITS - 1)) - 1);
+	for (size_t k = 0; k < level_circ.outputs.size(); ++k) {
+		Field alpha = v_preproc[0].gates[level_circ.outputs[k]]->tpmask.secret();
+		for (Field d : {Field(-1), Field(0), Field(1), Field(distrib(gen))}) {
+			uint8_t o0 = EDBitComparison::eval(0, &v_preproc[rider_index].dcf_keys[k * EDBitComparison::KEY_LEN_], uint64_t(d + alpha));
+			uint8_t o1 = EDBitComparison::eval(1, &v_preproc[driver_index].dcf_keys[k * EDBitComparison::KEY_LEN_], uint64_t(d + alpha));
+			BOOST_TEST(((o0 ^ o1) & 1) == int(d < 0));
+		}
+	}
+}
 BOOST_AUTO_TEST_SUITE_END()